@@ -10,6 +10,7 @@ import matplotlib.colors as mcolors
 import shutil
 from flask_cors import CORS
 import time 
+import os
 
 sys.path.insert(0, str(Path(__file__).parent / 'python' / 'pagerank'))
 import pagerank_cpp
@@ -21,6 +22,26 @@ app.secret_key = secrets.token_hex(16)
 # In-memory storage for graphs, keyed by session ID to allow multiple users to have their own graphs
 # TODO: Transfer to database for persistence and scalability
 graphs = {}
+
+# Most bytes one session's graph and results may hold in the C++ backend
+SESSION_MEMORY_LIMIT = int(os.environ.get('PAGERANK_SESSION_MEMORY_LIMIT', 256 * 2**20))
+
+
+def session_memory(graph, result=None):
+    """Bytes held by a session's graph and, if given, its last result."""
+    used = graph.memory_usage().total
+    if result is not None:
+        used += result.memory_usage()
+    return used
+
+
+def memory_limit_error(used):
+    return jsonify({
+        'error': 'Graph exceeds the per-session memory limit',
+        'memory_bytes': used,
+        'limit_bytes': SESSION_MEMORY_LIMIT
+    }), 413
+
 @app.route('/api/graph', methods=['POST'])
 def create_graph():
     # Get or create session ID
@@ -32,18 +53,29 @@ def create_graph():
     if not data or 'edges' not in data or 'nodes' not in data:
         return jsonify({'error': 'Invalid input data'}), 400
 
-    # Init graph 
+    # Init graph, rejecting oversized requests before any storage is allocated
     graph = pagerank_cpp.Graph()
+    graph.set_memory_budget(SESSION_MEMORY_LIMIT)
+    label_bytes = sum(len(str(node).encode()) for node in data['nodes'])
+    try:
+        graph.reserve(len(data['nodes']), len(data['edges']), label_bytes)
+    except ValueError:
+        return memory_limit_error(pagerank_cpp.Graph.estimate_memory(len(data['nodes']), len(data['edges']), label_bytes))
 
     # Add Nodes 
-    for node in data['nodes']:
-        graph.add_node(str(node))
+    graph.add_nodes([str(node) for node in data['nodes']])
 
     # Add Edges 
-    for edge in data['edges']:
-        if len(edge) != 2:
-            return jsonify({'error': 'Each edge must have exactly two nodes'}), 400
-        graph.add_edge(str(edge[0]), str(edge[1]))
+    if any(len(edge) != 2 for edge in data['edges']):
+        return jsonify({'error': 'Each edge must have exactly two nodes'}), 400
+    graph.add_edges_by_label([str(edge[0]) for edge in data['edges']],
+                             [str(edge[1]) for edge in data['edges']])
+
+    # Build the sparse storage now so the limit covers what the solver will use
+    graph.finalize()
+    used = session_memory(graph)
+    if used > SESSION_MEMORY_LIMIT:
+        return memory_limit_error(used)
     
     # Store the graph
     graphs[session_id] = {
@@ -75,6 +107,10 @@ def compute_pagerank():
     # Sends a request to the C++ backend to compute PageRank and returns the results as JSON
     result = graph.compute_pagerank()
 
+    used = session_memory(graph, result)
+    if used > SESSION_MEMORY_LIMIT:
+        return memory_limit_error(used)
+
     graphs[session_id]['pagerank'] = result 
 
     return jsonify({
@@ -227,7 +263,9 @@ def health():
     return jsonify({
         'status': 'ok',
         'message': 'PageRank API is running',
-        'active_sessions': len(graphs)
+        'active_sessions': len(graphs),
+        'allocated_bytes': pagerank_cpp.allocated_bytes(),
+        'peak_allocated_bytes': pagerank_cpp.peak_allocated_bytes()
     }), 200
 
 def cleanup_old_sessions(max_age_hours=24):
@@ -1,27 +1,353 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "fingerprint.h"
 #include "graph.h"
+#include "memory.h"
+#include "parallel.h"
 
 namespace py = pybind11;
 
+/*
+ * Borrows the UTF-8 buffer of every str in `labels`, with the GIL held.
+ * The buffers belong to the str objects, which `owner` keeps alive (and
+ * unchanged, being a tuple) after the GIL is released.
+ */
+static std::vector<std::string_view> utf8_views(const py::sequence& labels, py::tuple& owner)
+{
+    owner = py::tuple(labels);
+
+    std::vector<std::string_view> views;
+    views.reserve(owner.size());
+    for(py::handle item : owner)
+    {
+        Py_ssize_t size = 0;
+        const char* data = PyUnicode_AsUTF8AndSize(item.ptr(), &size);
+        if(data == nullptr)
+            throw py::error_already_set();
+        views.emplace_back(data, static_cast<size_t>(size));
+    }
+    return views;
+}
+
+/*
+ * Runs fn(graph) with the GIL released and the graph's mutex held, so a Graph
+ * shared between Python threads is never read while another call changes it.
+ * The GIL goes first and comes back last, so a thread waiting for the mutex
+ * never holds the GIL the mutex holder needs to return.
+ */
+template <typename Fn>
+static auto with_graph(Graph& graph, Fn&& fn)
+{
+    py::gil_scoped_release release;
+    std::lock_guard<std::mutex> lock(graph.get_mutex());
+    return fn(graph);
+}
+
+/*
+ * As above for per-item calls too short to be worth giving up the GIL,
+ * which already orders them against each other. The mutex is free unless a
+ * bulk call or solve runs; only then is the GIL released to wait for it, so
+ * a thread holding the GIL still never blocks on the mutex.
+ */
+template <typename Fn>
+static auto with_graph_quick(Graph& graph, Fn&& fn)
+{
+    std::unique_lock<std::mutex> lock(graph.get_mutex(), std::try_to_lock);
+    if(!lock.owns_lock())
+    {
+        py::gil_scoped_release release;
+        lock.lock();
+    }
+    return fn(graph);
+}
+
 PYBIND11_MODULE(pagerank_cpp, m){
     m.doc() = "C++ implementation of PageRank algorithm";
     
     /* Expose the Result struct */
     py::class_<PageRankResult>(m, "Result")
         .def_readonly("pagerank_scores", &PageRankResult::pagerank_vector, "Computed PageRank scores for each node")
+        .def_readonly("cheirank_scores", &PageRankResult::cheirank_vector, "PageRank of the transposed graph, empty unless requested")
         .def_readonly("convergence_history", &PageRankResult::convergence_history, "History of convergence differences per iteration")
-        .def_readonly("num_iterations", &PageRankResult::iterations, "Number of iterations taken to converge");
+        .def_readonly("num_iterations", &PageRankResult::iterations, "Number of iterations taken to converge")
+        .def_readonly("solver", &PageRankResult::solver, "Solver that produced the scores")
+        .def_readonly("in_place", &PageRankResult::in_place, "Whether the solver ran Gauss-Seidel sweeps")
+        .def_readonly("num_threads", &PageRankResult::num_threads, "Threads the iteration ran on")
+        .def_readonly("termination", &PageRankResult::termination, "Criterion that stopped the iteration")
+        .def("memory_usage", &PageRankResult::memory_usage, "Heap bytes held by the scores and the history");
+
+    /* Expose the convergence norms */
+    py::enum_<ConvergenceNorm>(m, "ConvergenceNorm")
+        .value("L1", ConvergenceNorm::L1)
+        .value("LINF", ConvergenceNorm::LINF)
+        .value("RELATIVE", ConvergenceNorm::RELATIVE);
+
+    /* Expose the summation modes */
+    py::enum_<Summation>(m, "Summation")
+        .value("NAIVE", Summation::NAIVE)
+        .value("KAHAN", Summation::KAHAN)
+        .value("PAIRWISE", Summation::PAIRWISE);
+
+    /* Expose the termination criteria */
+    py::enum_<TerminationReason>(m, "TerminationReason")
+        .value("RESIDUAL", TerminationReason::RESIDUAL)
+        .value("TOP_K", TerminationReason::TOP_K)
+        .value("MAX_ITER", TerminationReason::MAX_ITER);
+
+    /* Expose the solver choices */
+    py::enum_<Solver>(m, "Solver")
+        .value("AUTO", Solver::AUTO)
+        .value("DENSE", Solver::DENSE)
+        .value("SPARSE", Solver::SPARSE)
+        .value("SMALL", Solver::SMALL)
+        .value("LUMPED", Solver::LUMPED)
+        .value("AGGREGATION", Solver::AGGREGATION)
+        .value("BITSET", Solver::BITSET);
+
+    py::enum_<Prefetch>(m, "Prefetch")
+        .value("AUTO", Prefetch::AUTO)
+        .value("ON", Prefetch::ON)
+        .value("OFF", Prefetch::OFF);
+
+    py::enum_<DanglingPolicy>(m, "DanglingPolicy")
+        .value("UNIFORM", DanglingPolicy::UNIFORM)
+        .value("TELEPORT", DanglingPolicy::TELEPORT)
+        .value("SELF_LOOP", DanglingPolicy::SELF_LOOP);
+
+    py::enum_<Precision>(m, "Precision")
+        .value("DOUBLE", Precision::DOUBLE)
+        .value("FLOAT", Precision::FLOAT);
+
+    py::enum_<Acceleration>(m, "Acceleration")
+        .value("NONE", Acceleration::NONE)
+        .value("CHEBYSHEV", Acceleration::CHEBYSHEV)
+        .value("MOMENTUM", Acceleration::MOMENTUM);
+
+    /* Expose the solver options */
+    py::class_<PageRankOptions>(m, "Options")
+        .def(py::init<>())
+        .def_readwrite("solver", &PageRankOptions::solver, "Matrix representation to iterate over")
+        .def_readwrite("norm", &PageRankOptions::norm, "Norm of the residual compared against the convergence threshold")
+        .def_readwrite("check_every", &PageRankOptions::check_every, "Measure the residual every k iterations")
+        .def_readwrite("in_place", &PageRankOptions::in_place, "Update a single score vector in place (Gauss-Seidel)")
+        .def_readwrite("summation", &PageRankOptions::summation, "Summation mode used by every reduction")
+        .def_readwrite("renormalize_every", &PageRankOptions::renormalize_every, "Rescale the scores to sum 1 every k iterations (0 = never)")
+        .def_readwrite("prefetch", &PageRankOptions::prefetch, "Software prefetching in the sparse gather kernel")
+        .def_readwrite("prefetch_distance", &PageRankOptions::prefetch_distance, "How many edges ahead to prefetch")
+        .def_readwrite("dangling", &PageRankOptions::dangling, "Where the score of nodes without out-links goes")
+        .def_readwrite("personalization", &PageRankOptions::personalization, "Teleport weight per node label, uniform when empty")
+        .def_readwrite("precision", &PageRankOptions::precision, "Score storage type in the sparse solver")
+        .def_readwrite("num_threads", &PageRankOptions::num_threads, "Threads of the sparse and dense solvers (0 = chosen from the graph size)")
+        .def_readwrite("num_blocks", &PageRankOptions::num_blocks, "Coarse blocks of the aggregation solver (0 = chosen from the edge count, at most 256)")
+        .def_readwrite("acceleration", &PageRankOptions::acceleration, "Extrapolation of the sparse solver's Jacobi steps")
+        .def_readwrite("reduce", &PageRankOptions::reduce, "Peel trees and contract chains before a sparse solve, expanding the scores back exactly")
+        .def_readwrite("cheirank", &PageRankOptions::cheirank, "Also compute CheiRank, the PageRank of the transposed graph, in the same pass over the edges")
+        .def_readwrite("top_k", &PageRankOptions::top_k, "Also stop once the ranking of the k highest scores settles (0 = residual only)")
+        .def_readwrite("top_k_stable", &PageRankOptions::top_k_stable, "Measurements in a row the top-k ranking must repeat (0 counts as 1)")
+        .def_readwrite("top_k_margin", &PageRankOptions::top_k_margin, "Lead the k-th score must keep over the next, in multiples of the watched scores' last change");
+
+    /* Huge page backing for graph storage and solver buffers */
+    py::enum_<HugePageMode>(m, "HugePageMode")
+        .value("OFF", HugePageMode::OFF)
+        .value("TRANSPARENT", HugePageMode::TRANSPARENT)
+        .value("EXPLICIT", HugePageMode::EXPLICIT);
+
+    m.def("set_huge_page_mode", &set_huge_page_mode, "Select how buffers of 2 MB and larger are backed",
+          py::arg("mode"));
+    m.def("get_huge_page_mode", &get_huge_page_mode, "Current huge page mode");
+
+    /* Process-wide accounting of graph storage and solver buffers */
+    m.def("allocated_bytes", &allocated_bytes, "Bytes of graph storage and solver buffers held right now");
+    m.def("peak_allocated_bytes", &peak_allocated_bytes, "Most bytes of graph storage and solver buffers held at once");
+    m.def("reset_peak_allocated_bytes", &reset_peak_allocated_bytes, "Restart the peak from the current allocation");
+
+    /* Heap bytes held by a graph */
+    py::class_<MemoryUsage>(m, "MemoryUsage")
+        .def_readonly("structure", &MemoryUsage::structure, "Edge lists, sparse storage and degrees")
+        .def_readonly("labels", &MemoryUsage::labels, "Node label strings")
+        .def_readonly("index", &MemoryUsage::index, "Label to index lookup")
+        .def_readonly("caches", &MemoryUsage::caches, "Statistics, adjacency bits and reduction, rebuilt on demand")
+        .def_property_readonly("total", &MemoryUsage::total, "Sum of every category");
+
+    /* Thread count used by every parallel pass */
+    m.def("set_max_threads", &set_max_threads, "Cap the worker threads of parallel passes (0 = hardware concurrency)",
+          py::arg("num_threads"));
+    m.def("get_max_threads", &get_max_threads, "Worker threads parallel passes may use");
+
+    /* Structural statistics, computed when the sparse storage is built */
+    py::class_<GraphStats>(m, "GraphStats")
+        .def_readonly("num_nodes", &GraphStats::num_nodes, "Number of nodes")
+        .def_readonly("num_edges", &GraphStats::num_edges, "Number of distinct edges")
+        .def_readonly("num_dangling", &GraphStats::num_dangling, "Nodes without out-links")
+        .def_readonly("num_sources", &GraphStats::num_sources, "Nodes without in-links")
+        .def_readonly("num_self_loops", &GraphStats::num_self_loops, "Edges from a node to itself")
+        .def_readonly("max_in_degree", &GraphStats::max_in_degree, "Largest in-degree")
+        .def_readonly("max_out_degree", &GraphStats::max_out_degree, "Largest out-degree")
+        .def_readonly("reciprocity", &GraphStats::reciprocity, "Fraction of non-loop edges whose reverse edge exists")
+        .def_readonly("num_sccs", &GraphStats::num_sccs, "Number of strongly connected components")
+        .def_readonly("largest_scc", &GraphStats::largest_scc, "Nodes in the largest strongly connected component")
+        .def_readonly("in_degree_histogram", &GraphStats::in_degree_histogram, "Number of nodes per in-degree")
+        .def_readonly("out_degree_histogram", &GraphStats::out_degree_histogram, "Number of nodes per out-degree")
+        .def_readonly("dangling_nodes", &GraphStats::dangling_nodes, "Indices of the nodes without out-links")
+        .def_property_readonly("density", &GraphStats::density, "Edges divided by n^2")
+        .def_property_readonly("dangling_fraction", &GraphStats::dangling_fraction, "Fraction of nodes without out-links");
+
+    /* Monte Carlo Personalized PageRank index */
+    py::class_<FingerprintOptions>(m, "FingerprintOptions")
+        .def(py::init<>())
+        .def_readwrite("walks_per_node", &FingerprintOptions::walks_per_node, "Random walks stored per seed; score errors shrink as 1 / sqrt(walks)")
+        .def_readwrite("seed", &FingerprintOptions::seed, "Random seed, the same seed gives the same index")
+        .def_readwrite("num_threads", &FingerprintOptions::num_threads, "Threads of the build (0 = by graph size)");
+
+    py::class_<FingerprintIndex>(m, "FingerprintIndex")
+        .def_static("load", [](const std::string& path) {
+                        py::gil_scoped_release release;
+                        return FingerprintIndex::load(path);
+                    },
+                    "Map an index written by save(); raises RuntimeError when the file is missing or not an index",
+                    py::arg("path"))
+        .def("save", [](const FingerprintIndex& index, const std::string& path) {
+                 py::gil_scoped_release release;
+                 index.save(path);
+             },
+             "Write the index to a file that load() maps back",
+             py::arg("path"))
+        .def("top_k", [](const FingerprintIndex& index, const std::string& seed, size_t k) {
+                 py::gil_scoped_release release;
+                 return index.top_k(std::string_view(seed), k);
+             },
+             "The k nodes with the highest estimated Personalized PageRank from seed, as (label, score) pairs, best first (k = 0 for all); empty for unknown seeds",
+             py::arg("seed"), py::arg("k") = 10)
+        .def("num_nodes", &FingerprintIndex::get_num_nodes, "Number of seeds")
+        .def("walks_per_node", &FingerprintIndex::get_walks_per_node, "Random walks stored per seed")
+        .def("alpha", &FingerprintIndex::get_alpha, "Damping factor of the walks")
+        .def("is_mapped", &FingerprintIndex::is_mapped, "Whether the index is a read-only mapping of a file")
+        .def("size_bytes", &FingerprintIndex::size_bytes, "Bytes of the index, as in memory and on disk");
 
     /* Bind the Graph class */
     py::class_<Graph>(m, "Graph")
         .def(py::init<>())
-        .def("add_node", &Graph::add_node, "Add a node to the graph",
+        .def("add_node", [](Graph& graph, const std::string& label) {
+                 with_graph_quick(graph, [&](Graph& g) { g.add_node(label); });
+             },
+             "Add a node to the graph",
              py::arg("label"))
-        .def("add_edge", &Graph::add_edge, "Add an edge to the graph",
+        .def("add_edge", [](Graph& graph, const std::string& src, const std::string& dest, double weight) {
+                 with_graph_quick(graph, [&](Graph& g) { g.add_edge(src, dest, weight); });
+             },
+             "Add an edge to the graph",
+             py::arg("src"), py::arg("dest"), py::arg("weight") = 1.0)
+        .def("add_nodes", [](Graph& graph, const py::sequence& labels) {
+                 py::tuple owner;
+                 std::vector<std::string_view> views = utf8_views(labels, owner);
+                 with_graph(graph, [&](Graph& g) { g.add_nodes(views); });
+             },
+             "Add every label in the list as a node, in order, skipping ones already present",
+             py::arg("labels"))
+        .def("resolve_labels", [](Graph& graph, const py::sequence& labels) {
+                 py::tuple owner;
+                 std::vector<std::string_view> views = utf8_views(labels, owner);
+                 py::array_t<int64_t> indices(static_cast<py::ssize_t>(views.size()));
+                 int64_t* out = indices.mutable_data();
+                 with_graph(graph, [&](Graph& g) { g.resolve_labels(views, out); });
+                 return indices;
+             },
+             "Node index of every label as an int64 array, -1 for unknown labels",
+             py::arg("labels"))
+        .def("add_edges_by_label", [](Graph& graph, const py::sequence& src, const py::sequence& dest) {
+                 py::tuple src_owner, dest_owner;
+                 std::vector<std::string_view> src_views  = utf8_views(src, src_owner);
+                 std::vector<std::string_view> dest_views = utf8_views(dest, dest_owner);
+                 return with_graph(graph, [&](Graph& g) { return g.add_edges_by_label(src_views, dest_views); });
+             },
+             "Add an edge src[i] -> dest[i] for every i, skipping unknown labels; returns the number added",
              py::arg("src"), py::arg("dest"))
-        .def("get_edges", &Graph::get_edges, "Get all edges in the graph")
-        .def("get_nodes", &Graph::get_nodes, "Get all nodes in the graph")
-        .def("num_nodes", &Graph::get_num_nodes, "Get the number of nodes in the graph")
-        .def("compute_pagerank", &Graph::compute_pagerank, "Compute PageRank scores");
+        .def("subgraph", [](Graph& graph, const py::sequence& labels) {
+                 py::tuple owner;
+                 std::vector<std::string_view> views = utf8_views(labels, owner);
+                 return with_graph(graph, [&](Graph& g) { return g.subgraph(views); });
+             },
+             "Compact copy of the subgraph induced by the labels, ready to solve; unknown labels are ignored",
+             py::arg("labels"))
+        .def("reserve", [](Graph& graph, size_t num_nodes, size_t num_edges, size_t label_bytes, bool weighted) {
+                 with_graph(graph, [&](Graph& g) { g.reserve(num_nodes, num_edges, label_bytes, weighted); });
+             },
+             "Declare the final size up front; raises ValueError when its estimate exceeds the memory budget",
+             py::arg("num_nodes"), py::arg("num_edges"), py::arg("label_bytes") = 0, py::arg("weighted") = false)
+        .def("set_memory_budget", [](Graph& graph, size_t bytes) {
+                 with_graph_quick(graph, [&](Graph& g) { g.set_memory_budget(bytes); });
+             },
+             "Bytes the graph and its solves may use (0 = unlimited)",
+             py::arg("bytes"))
+        .def("get_memory_budget", [](Graph& graph) {
+                 return with_graph_quick(graph, [](Graph& g) { return g.get_memory_budget(); });
+             },
+             "Bytes the graph and its solves may use")
+        .def_static("estimate_memory", &Graph::estimate_memory, "Peak bytes of a graph of this size, without building it",
+                    py::arg("num_nodes"), py::arg("num_edges"), py::arg("label_bytes") = 0, py::arg("weighted") = false)
+        .def_static("dense_memory", &Graph::dense_memory, "Bytes the dense solver needs for a graph of this many nodes",
+                    py::arg("num_nodes"))
+        .def("finalize", [](Graph& graph) {
+                 with_graph(graph, [](Graph& g) { g.finalize(); });
+             },
+             "Build the sparse storage and statistics now rather than on the first solve")
+        .def("get_edges", [](Graph& graph) {
+                 return with_graph(graph, [](Graph& g) { return g.get_edges(); });
+             },
+             "Get all edges in the graph")
+        .def("get_nodes", [](Graph& graph) {
+                 return with_graph(graph, [](Graph& g) { return g.get_nodes(); });
+             },
+             "Get all nodes in the graph")
+        .def("num_nodes", [](Graph& graph) {
+                 return with_graph_quick(graph, [](Graph& g) { return g.get_num_nodes(); });
+             },
+             "Get the number of nodes in the graph")
+        .def("is_weighted", [](Graph& graph) {
+                 return with_graph_quick(graph, [](Graph& g) { return g.is_weighted(); });
+             },
+             "Whether any edge has a weight other than 1")
+        .def("memory_usage", [](Graph& graph) {
+                 return with_graph_quick(graph, [](Graph& g) { return g.memory_usage(); });
+             },
+             "Heap bytes held by the graph, by category")
+        .def("statistics", [](Graph& graph) {
+                 return with_graph(graph, [](Graph& g) { return GraphStats(g.get_statistics()); });
+             },
+             "Structural statistics of the graph, cached until it changes")
+        .def("build_fingerprint_index", [](Graph& graph, const FingerprintOptions& options) {
+                 return with_graph(graph, [&](Graph& g) { return g.build_fingerprint_index(options); });
+             },
+             "Run random walks from every node into an index of approximate Personalized PageRank",
+             py::arg("options") = FingerprintOptions())
+        .def("compute_pagerank", [](Graph& graph, const PageRankOptions& options) {
+                 return with_graph(graph, [&](Graph& g) { return g.compute_pagerank(options); });
+             },
+             "Compute PageRank scores", py::arg("options") = PageRankOptions());
+
+    m.def("solve_batch", [](const std::vector<Graph*>& graphs, const PageRankOptions& options) {
+              py::gil_scoped_release release;
+
+              /* Every distinct graph locked in address order, so two overlapping batches cannot deadlock */
+              std::vector<Graph*> distinct;
+              for(Graph* graph : graphs)
+                  if(graph != nullptr)
+                      distinct.push_back(graph);
+              std::sort(distinct.begin(), distinct.end(), std::less<Graph*>());
+              distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+              std::vector<std::unique_lock<std::mutex>> locks;
+              locks.reserve(distinct.size());
+              for(Graph* graph : distinct)
+                  locks.emplace_back(graph->get_mutex());
+              return Graph::solve_batch(graphs, options);
+          },
+          "Solve many small graphs in one block-diagonal pass across threads; one result per graph, in order",
+          py::arg("graphs"), py::arg("options") = PageRankOptions());
 }
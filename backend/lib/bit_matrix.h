@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "csr.h"
+#include "memory.h"
+
+/* Row length granularity of a BitMatrix: one cache line */
+constexpr size_t BIT_MATRIX_ROW_WORDS = 8;
+
+/*
+ * 0/1 matrix with one bit per entry, stored row after row. Bit j of row i is
+ * bit j % 64 of word j / 64 of the row. Rows are padded with zero bits to a
+ * whole number of cache lines, so a kernel can read any row in full lines
+ * without bounds checks.
+ */
+struct BitMatrix {
+    pr_vector<uint64_t> words;
+    size_t num_rows = 0;
+    size_t num_cols = 0;
+    size_t words_per_row = 0;
+
+    const uint64_t* row(size_t i) const { return words.data() + i * words_per_row; }
+    bool test(size_t i, size_t j) const { return (row(i)[j >> 6] >> (j & 63)) & 1; }
+    bool empty() const { return words.empty(); }
+
+    /* Bytes the words of a num_rows x num_cols matrix take */
+    static size_t bytes_for(size_t num_rows, size_t num_cols)
+    {
+        size_t lines = (num_cols + 64 * BIT_MATRIX_ROW_WORDS - 1) / (64 * BIT_MATRIX_ROW_WORDS);
+        return num_rows * lines * BIT_MATRIX_ROW_WORDS * sizeof(uint64_t);
+    }
+};
+
+/* The pattern of `csr` as bits: entry (i, j) is set for every column j in row i */
+BitMatrix build_bit_matrix(const CSR& csr, size_t num_cols, size_t num_threads = 1);
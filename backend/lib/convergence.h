@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+#include "summation.h"
+
+/* Norm used to measure the change between two successive PageRank vectors */
+enum class ConvergenceNorm {
+    L1,         /* sum |r_new - r_old|                  */
+    LINF,       /* max |r_new - r_old|                  */
+    RELATIVE    /* sum |r_new - r_old| / sum |r_new|    */
+};
+
+/*
+ * Running residual, accumulated element by element while the solver writes r_new.
+ * This replaces a separate pass over both vectors after every iteration. Every
+ * norm is accumulated at once, a few adds per node, so the norm is picked when
+ * the value is read and never has to be a template parameter of a kernel.
+ */
+template <Summation S = Summation::NAIVE>
+struct Residual {
+    Accumulator<S> diff;
+    Accumulator<S> mass;
+    double max_diff = 0.0;
+
+    inline void add(double r_old, double r_new)
+    {
+        double d = std::abs(r_new - r_old);
+        diff.add(d);
+        mass.add(std::abs(r_new));
+        max_diff = (d > max_diff) ? d : max_diff;
+    }
+
+    /* Folds in the residual another thread measured over a different range */
+    inline void merge(const Residual& other)
+    {
+        diff.add(other.diff.value());
+        mass.add(other.mass.value());
+        max_diff = (other.max_diff > max_diff) ? other.max_diff : max_diff;
+    }
+
+    inline double value(ConvergenceNorm norm) const
+    {
+        switch(norm)
+        {
+            case ConvergenceNorm::LINF:     return max_diff;
+            case ConvergenceNorm::RELATIVE: return (mass.value() > 0.0) ? diff.value() / mass.value() : diff.value();
+            default:                        return diff.value();
+        }
+    }
+};
+
+template <Summation S>
+using SummationTag = std::integral_constant<Summation, S>;
+
+/*
+ * Calls kernel(summation_tag) with the summation mode lifted to a compile-time
+ * constant, so the per-element loops inside the kernel carry no branches on it.
+ */
+template <typename Kernel>
+inline auto dispatch_summation(Summation summation, Kernel&& kernel)
+{
+    switch(summation)
+    {
+        case Summation::KAHAN:    return kernel(SummationTag<Summation::KAHAN>{});
+        case Summation::PAIRWISE: return kernel(SummationTag<Summation::PAIRWISE>{});
+        default:                  return kernel(SummationTag<Summation::NAIVE>{});
+    }
+}
+
+/*
+ * Extrapolation weights for iterating x <- T(x) where the error of T shrinks
+ * by a real factor in [-rho, rho] per step. The Chebyshev semi-iteration
+ *
+ *     x_{k+1} = x_{k-1} + omega_{k+1} * (T(x_k) - x_{k-1})
+ *     omega_1 = 1,  omega_2 = 2 / (2 - rho^2),  omega_{k+1} = 1 / (1 - rho^2 omega_k / 4)
+ *
+ * cuts the error by rho / (1 + sqrt(1 - rho^2)) per step instead of rho.
+ * Momentum uses the limit of those weights from the second step on.
+ *
+ * The damping factor bounds rho for PageRank, but the bound is loose on most
+ * graphs, and extrapolating for a spectrum wider than the real one is slower
+ * than not extrapolating. So the first steps are plain, and rho is read off
+ * the ratio of their residuals once two ratios agree, capped by the bound.
+ * Early ratios can belong to a transient; extrapolation that falls behind
+ * what plain steps at rho would have done goes back to probing, once. A
+ * second miss means the slow modes are not real (the spectrum of a random
+ * expander fills a disk), and plain steps are the best there is. Complex
+ * eigenvalues (periodic structure) can make the recurrence grow; a residual
+ * above the one it started from switches it off for good.
+ */
+class ExtrapolationWeights {
+    private:
+        enum class Phase { PROBING, EXTRAPOLATING, OFF };
+
+        double bound;
+        double rho_squared = 0.0;
+        double omega = 1.0;
+        size_t step = 0;
+        size_t steps_per_residual;
+        bool chebyshev;
+        Phase phase = Phase::PROBING;
+        double last_residual = -1.0;
+        double last_ratio = -1.0;
+        double start_residual = 0.0;
+        double rho = 0.0;
+        size_t steps_extrapolated = 0;
+        size_t attempts = 0;
+
+        /* Agreement between successive residual ratios before they are trusted */
+        static constexpr double RATIO_TOLERANCE = 0.05;
+
+        /* Steps extrapolation gets before it is held to the plain rate */
+        static constexpr size_t GRACE_STEPS = 4;
+
+        /* Estimates of rho tried before extrapolation gives up */
+        static constexpr size_t MAX_ATTEMPTS = 2;
+
+    public:
+        ExtrapolationWeights(double bound, bool chebyshev, size_t steps_per_residual)
+            : bound(bound), steps_per_residual(steps_per_residual == 0 ? 1 : steps_per_residual), chebyshev(chebyshev) {}
+
+        /* Weight of the next step, 1 for a plain step */
+        double next()
+        {
+            if(phase != Phase::EXTRAPOLATING)
+                return 1.0;
+
+            step++;
+            if(step == 1)
+                omega = 1.0;
+            else if(!chebyshev)
+                omega = 2.0 / (1.0 + std::sqrt(1.0 - rho_squared));
+            else if(step == 2)
+                omega = 2.0 / (2.0 - rho_squared);
+            else
+                omega = 1.0 / (1.0 - rho_squared * omega / 4.0);
+            return omega;
+        }
+
+        /* Feeds a measured residual: estimates rho while probing, watches for divergence after */
+        void observe(double residual)
+        {
+            if(phase == Phase::PROBING && last_residual > 0.0)
+            {
+                double ratio = std::pow(residual / last_residual, 1.0 / static_cast<double>(steps_per_residual));
+                if(last_ratio > 0.0 && std::abs(ratio - last_ratio) <= RATIO_TOLERANCE * ratio && ratio < 1.0)
+                {
+                    rho = std::min(bound, ratio);
+                    rho_squared = rho * rho;
+                    start_residual = residual;
+                    steps_extrapolated = 0;
+                    step = 0;
+                    attempts++;
+                    phase = Phase::EXTRAPOLATING;
+                }
+                last_ratio = ratio;
+            }
+            else if(phase == Phase::EXTRAPOLATING)
+            {
+                steps_extrapolated += steps_per_residual;
+                if(residual > start_residual)
+                    phase = Phase::OFF;
+                else if(steps_extrapolated >= GRACE_STEPS &&
+                        residual > start_residual * std::pow(rho, static_cast<double>(steps_extrapolated)))
+                {
+                    phase = (attempts < MAX_ATTEMPTS) ? Phase::PROBING : Phase::OFF;
+                    last_ratio = -1.0;
+                }
+            }
+
+            last_residual = residual;
+        }
+};
+
+/* Criterion that ended an iteration */
+enum class TerminationReason {
+    RESIDUAL,   /* The residual fell below the threshold        */
+    TOP_K,      /* The top-k ranking settled                    */
+    MAX_ITER    /* The iteration limit was reached              */
+};
+
+/* When a ranking of the k highest scores counts as settled */
+struct TopKCriterion {
+    size_t k = 0;           /* Ranks watched, 0 = residual only */
+    size_t stable = 2;      /* Measurements in a row the ranking must repeat, 0 counts as 1 */
+    double margin = 1.0;    /* Lead of the k-th over the (k+1)-th, in last changes of the watched scores */
+};
+
+/*
+ * Watches the k highest scores across measurements. The ranking is settled
+ * once the same k nodes, in the same order, have come out on top `stable`
+ * measurements in a row, and the k-th leads the (k+1)-th by at least
+ * `margin` times the largest change of a watched score since the last
+ * measurement. The scores still move after that, but the order the caller
+ * reads off them no longer does.
+ *
+ * Each measurement selects the top k + 1 among the nodes scoring at least
+ * half the last runner-up, falling back to every node when fewer do.
+ */
+class TopKWatch {
+    private:
+        TopKCriterion criterion;
+        std::vector<int> order;             /* Node order of the selection, reused */
+        std::vector<int> leaders;           /* Top k of the last measurement, best first */
+        std::vector<double> leader_scores;
+        int runner_up = -1;                 /* Its (k+1)-th, -1 when every node ranks */
+        double runner_up_score = 0.0;
+        size_t repeats = 0;
+
+        /* Fraction the last runner-up score may drop by and still bound the candidates */
+        static constexpr double CANDIDATE_SLACK = 0.5;
+
+    public:
+        explicit TopKWatch(const TopKCriterion& criterion) : criterion(criterion)
+        {
+            /* A ranking seen once has not repeated yet */
+            if(this->criterion.stable == 0)
+                this->criterion.stable = 1;
+        }
+
+        bool active() const { return criterion.k != 0; }
+
+        template <typename Scalar>
+        bool settled(const Scalar* scores, size_t n)
+        {
+            const size_t top = std::min(criterion.k, n);
+            const size_t kept = std::min(criterion.k + 1, n);
+            auto better = [scores](int a, int b) {
+                return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+            };
+
+            /* Scores move little between measurements: nodes far below the last runner-up cannot rank */
+            order.clear();
+            if(runner_up >= 0)
+            {
+                const double threshold = runner_up_score * (1.0 - CANDIDATE_SLACK);
+                for(size_t v = 0; v < n; v++)
+                    if(static_cast<double>(scores[v]) >= threshold)
+                        order.push_back(static_cast<int>(v));
+            }
+            if(order.size() < kept)
+            {
+                order.resize(n);
+                std::iota(order.begin(), order.end(), 0);
+            }
+            if(kept < order.size())
+                std::nth_element(order.begin(), order.begin() + kept, order.end(), better);
+            std::sort(order.begin(), order.begin() + kept, better);
+
+            bool same = leaders.size() == top && std::equal(leaders.begin(), leaders.end(), order.begin());
+            double change = 0.0;
+            if(same)
+            {
+                for(size_t i = 0; i < top; i++)
+                    change = std::max(change, std::abs(static_cast<double>(scores[leaders[i]]) - leader_scores[i]));
+                if(kept > top && runner_up == order[top])
+                    change = std::max(change, std::abs(static_cast<double>(scores[runner_up]) - runner_up_score));
+            }
+            repeats = same ? repeats + 1 : 0;
+
+            leaders.assign(order.begin(), order.begin() + top);
+            leader_scores.resize(top);
+            for(size_t i = 0; i < top; i++)
+                leader_scores[i] = static_cast<double>(scores[leaders[i]]);
+            runner_up = (kept > top) ? order[top] : -1;
+            runner_up_score = (kept > top) ? static_cast<double>(scores[runner_up]) : 0.0;
+
+            if(repeats < criterion.stable)
+                return false;
+            if(runner_up < 0)
+                return true;
+            return leader_scores[top - 1] - runner_up_score >= criterion.margin * change;
+        }
+};
+
+/* Decides which iterations measure a residual and records the convergence history */
+class ConvergenceTracker {
+    private:
+        std::vector<double> history;
+        size_t check_every;
+        size_t max_iter;
+        double epsilon;
+        TopKWatch watch;
+        TerminationReason reason = TerminationReason::MAX_ITER;
+
+    public:
+        ConvergenceTracker(size_t check_every, double epsilon, size_t max_iter,
+                           const TopKCriterion& top_k = TopKCriterion())
+            : check_every(check_every == 0 ? 1 : check_every), max_iter(max_iter), epsilon(epsilon), watch(top_k)
+        {
+            history.reserve(max_iter / this->check_every + 1);
+        }
+
+        /* Iteration `iter` (0-based) measures its residual every k-th iteration and on the last one */
+        bool measure(size_t iter) const
+        {
+            return ((iter + 1) % check_every == 0) || (iter + 1 == max_iter);
+        }
+
+        /* Records a measured residual, returns true once it falls below epsilon */
+        bool converged(double residual)
+        {
+            history.push_back(residual);
+            if(residual < epsilon)
+                reason = TerminationReason::RESIDUAL;
+            return residual < epsilon;
+        }
+
+        /* As above, or once the top-k ranking of the measured scores has settled */
+        template <typename Scalar>
+        bool converged(double residual, const Scalar* scores, size_t n)
+        {
+            if(converged(residual))
+                return true;
+            if(watch.active() && watch.settled(scores, n))
+                reason = TerminationReason::TOP_K;
+            return reason == TerminationReason::TOP_K;
+        }
+
+        /* Marks a solve that needed no iterations */
+        void mark_exact() { reason = TerminationReason::RESIDUAL; }
+
+        std::vector<double>& get_history() { return history; }
+        size_t get_check_every() const { return check_every; }
+        TerminationReason get_reason() const { return reason; }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "memory.h"
+
+/*
+ * Compressed sparse rows.
+ * Row i's entries are indices[offsets[i] .. offsets[i + 1]), sorted and without duplicates.
+ * weights runs parallel to indices and is left empty for unweighted graphs.
+ */
+struct CSR {
+    pr_vector<size_t> offsets;
+    pr_vector<int> indices;
+    pr_vector<double> weights;
+
+    size_t num_rows() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t num_entries() const { return indices.size(); }
+    size_t degree(size_t row) const { return offsets[row + 1] - offsets[row]; }
+    bool is_weighted() const { return !weights.empty(); }
+};
+
+/*
+ * Builds the CSR holding entry cols[k] in row rows[k] for every k.
+ * Repeated entries collapse into one; with weights the last one added wins.
+ * Passing (dest, src) instead of (src, dest) builds the CSC, i.e. the in-links.
+ *
+ * Two-pass counting sort: per-thread row histograms, a prefix sum into
+ * per-thread write cursors, a scatter, then a per-row sort and deduplication.
+ */
+CSR build_csr(size_t num_rows, const pr_vector<int>& rows, const pr_vector<int>& cols,
+              const pr_vector<double>* weights = nullptr, size_t num_threads = 1);
+
+/* Number of entries and total weight (1 per entry when unweighted) of every column */
+void column_sums(const CSR& csr, size_t num_cols, pr_vector<int>& counts, pr_vector<double>& weight_sums,
+                 size_t num_threads = 1);
+
+/*
+ * Boundaries of `parts` contiguous row ranges with about the same number of
+ * rows plus entries each, so skewed degree distributions still split evenly.
+ */
+std::vector<size_t> balanced_row_splits(const CSR& csr, size_t parts);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "memory.h"
+
+/* Row length granularity of a DenseMatrix: one cache line of doubles */
+constexpr size_t DENSE_MATRIX_ROW_DOUBLES = 8;
+
+/*
+ * Row-major matrix of doubles in a single buffer. Every row starts on a
+ * cache line: the buffer is over-allocated by one line less a double and the
+ * first row begins at the first aligned element, and rows are padded with
+ * zeros to a whole number of lines.
+ */
+class DenseMatrix {
+    private:
+        static size_t padded(size_t num_cols)
+        {
+            return (num_cols + DENSE_MATRIX_ROW_DOUBLES - 1) / DENSE_MATRIX_ROW_DOUBLES * DENSE_MATRIX_ROW_DOUBLES;
+        }
+
+        pr_vector<double> storage;
+        size_t rows = 0;
+        size_t cols = 0;
+        size_t row_stride = 0;
+        size_t offset = 0;      /* Doubles before the first aligned one */
+
+    public:
+        DenseMatrix() = default;
+        DenseMatrix(size_t num_rows, size_t num_cols)
+            : storage(num_rows * padded(num_cols) + DENSE_MATRIX_ROW_DOUBLES - 1, 0.0),
+              rows(num_rows), cols(num_cols), row_stride(padded(num_cols))
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+            size_t misaligned = (address / sizeof(double)) % DENSE_MATRIX_ROW_DOUBLES;
+            offset = (DENSE_MATRIX_ROW_DOUBLES - misaligned) % DENSE_MATRIX_ROW_DOUBLES;
+        }
+
+        /* Moving keeps the buffer and so its alignment, a copy would not */
+        DenseMatrix(const DenseMatrix&) = delete;
+        DenseMatrix& operator=(const DenseMatrix&) = delete;
+        DenseMatrix(DenseMatrix&&) = default;
+        DenseMatrix& operator=(DenseMatrix&&) = default;
+
+        double* row(size_t i) { return storage.data() + offset + i * row_stride; }
+        const double* row(size_t i) const { return storage.data() + offset + i * row_stride; }
+
+        size_t num_rows() const { return rows; }
+        size_t num_cols() const { return cols; }
+        size_t stride() const { return row_stride; }   /* Doubles from one row to the next */
+
+        /* Bytes the buffer of a num_rows x num_cols matrix takes */
+        static size_t bytes_for(size_t num_rows, size_t num_cols)
+        {
+            return allocation_size((num_rows * padded(num_cols) + DENSE_MATRIX_ROW_DOUBLES - 1) * sizeof(double));
+        }
+};
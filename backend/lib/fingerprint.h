@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "label_index.h"
+#include "memory.h"
+
+/* Options of a fingerprint index build */
+struct FingerprintOptions {
+    size_t walks_per_node = 256;    /* Fingerprints per seed; score errors shrink as 1 / sqrt(walks) */
+    uint64_t seed = 0;              /* Random seed; a build is reproducible for a given seed */
+    size_t num_threads = 0;         /* Threads of the build (0 = by graph size) */
+};
+
+/*
+ * Monte Carlo index of Personalized PageRank (Fogaras et al.). For every seed
+ * s it stores where `walks_per_node` random walks from s end: each walk
+ * continues along a random out-link with probability alpha and stops
+ * otherwise, jumping back to s from dangling nodes. The share of walks ending
+ * at v estimates PPR_s(v) under the TELEPORT policy with all teleport weight on
+ * s, so a query decodes one seed's endpoints and never touches the graph.
+ *
+ * The endpoints of a seed are kept as (node, count) runs in node order,
+ * delta- and varint-encoded, which takes a few bytes per distinct endpoint.
+ * The index in memory is byte for byte the file save() writes; load() maps
+ * that file read-only instead of reading it, so only the queried seeds' pages
+ * are ever faulted in. Node labels are stored alongside, making the file
+ * self-contained.
+ */
+class FingerprintIndex {
+    private:
+        pr_vector<unsigned char> image;     /* The file image of a fresh build, empty when mapped */
+        const unsigned char* mapping = nullptr;
+        size_t mapping_bytes = 0;
+
+        /* Views into the image or the mapping */
+        const unsigned char* data = nullptr;
+        const uint64_t* offsets = nullptr;          /* Endpoint runs of seed s: data[offsets[s] .. offsets[s + 1]) */
+        size_t num_nodes = 0;
+        size_t walks = 0;
+        double alpha = 0.0;
+
+        /* Labels, copied out of the image for the label lookup */
+        std::vector<std::string> labels;
+        LabelIndex label_index;
+
+        void attach(const unsigned char* bytes, size_t size);
+        void release() noexcept;
+
+    public:
+        FingerprintIndex() = default;
+        FingerprintIndex(const FingerprintIndex&) = delete;
+        FingerprintIndex& operator=(const FingerprintIndex&) = delete;
+        FingerprintIndex(FingerprintIndex&& other) noexcept;
+        FingerprintIndex& operator=(FingerprintIndex&& other) noexcept;
+        ~FingerprintIndex() { release(); }
+
+        /*
+         * Assembles an index from the endpoint runs of every seed, already
+         * encoded and concatenated in seed order (`run_offsets` has one more
+         * entry than there are labels).
+         */
+        static FingerprintIndex from_runs(const std::vector<std::string>& labels, size_t walks_per_node, double alpha,
+                                          const std::vector<uint64_t>& run_offsets,
+                                          const std::vector<unsigned char>& runs);
+
+        /* Writes the index to `path`, or maps a file written before; both throw std::runtime_error on failure */
+        void save(const std::string& path) const;
+        static FingerprintIndex load(const std::string& path);
+
+        /*
+         * The k nodes with the highest estimated PPR from `seed` (all of them
+         * when k is 0), best first, ties in node order. Unknown seeds give an
+         * empty list; runs that do not decode to valid nodes throw
+         * std::runtime_error.
+         */
+        std::vector<std::pair<int, double>> top_k(int seed, size_t k) const;
+        std::vector<std::pair<std::string, double>> top_k(std::string_view seed, size_t k) const;
+
+        size_t get_num_nodes() const { return this->num_nodes; }
+        size_t get_walks_per_node() const { return this->walks; }
+        double get_alpha() const { return this->alpha; }
+        bool is_mapped() const { return this->mapping != nullptr; }
+        size_t size_bytes() const { return is_mapped() ? this->mapping_bytes : this->image.size(); }
+};
@@ -2,22 +2,159 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <map>
+#include <mutex>
+#include <stdexcept>
+#include "bit_matrix.h"
+#include "convergence.h"
+#include "csr.h"
+#include "dense_matrix.h"
+#include "fingerprint.h"
+#include "graph_stats.h"
+#include "label_index.h"
+#include "memory.h"
+#include "reduction.h"
+
+struct SparseProblem;
+
+/* Graphs up to this many nodes are solved in fixed-size stack arrays */
+constexpr size_t SMALL_GRAPH_MAX = 16;
+
+/* Rows plus edges each sparse solver thread should get before another thread pays for its start */
+constexpr size_t SPARSE_WORK_PER_THREAD = size_t{1} << 16;
+
+/* Table lookups each bitset solver thread should get before another thread pays for its start */
+constexpr size_t BITSET_LOOKUPS_PER_THREAD = size_t{1} << 16;
+
+/* Matrix entries each dense solver thread should get before another thread pays for its start */
+constexpr size_t DENSE_ENTRIES_PER_THREAD = size_t{1} << 18;
+
+/* Matrix representation the solver iterates over */
+enum class Solver {
+    AUTO,       /* Picked per solve from the graph statistics           */
+    DENSE,      /* Full n x n Google matrix (SMALL for tiny graphs)     */
+    SPARSE,     /* Gather over in-links, O(n + m) per iteration         */
+    SMALL,      /* Unrolled kernel on stack arrays, tiny graphs only    */
+    LUMPED,     /* Sparse, iterating over non-dangling nodes only       */
+    AGGREGATION,/* Sparse, with a coarse correction over node blocks   */
+    BITSET      /* Adjacency bits and lookup tables, dense unweighted  */
+};
+
+/* Software prefetching in the sparse gather kernel */
+enum class Prefetch {
+    AUTO,       /* Enabled when the gathered arrays exceed the last-level cache */
+    ON,
+    OFF
+};
+
+/* Where the score of a node without out-links goes */
+enum class DanglingPolicy {
+    UNIFORM,    /* Spread over every node                           */
+    TELEPORT,   /* Follow the teleport (personalization) vector     */
+    SELF_LOOP   /* Stay on the dangling node                        */
+};
+
+/* Extrapolation between successive Jacobi steps of the sparse solver */
+enum class Acceleration {
+    NONE,
+    CHEBYSHEV,  /* Chebyshev semi-iteration, weights varying per step */
+    MOMENTUM    /* Fixed weight, the limit of the Chebyshev weights   */
+};
+
+/* Storage type of the score vectors in the sparse solver */
+enum class Precision {
+    DOUBLE,
+    FLOAT       /* Halves the memory traffic of the gathered scores */
+};
 
 struct PageRankResult {
     std::vector<double> pagerank_vector;
     std::vector<double> convergence_history;
     size_t iterations;
+    Solver solver = Solver::DENSE;      /* Solver that produced the scores */
+    bool in_place = false;              /* Whether it ran Gauss-Seidel sweeps */
+    size_t num_threads = 1;             /* Threads the iteration ran on */
+    std::vector<double> cheirank_vector;    /* PageRank of the transposed graph, empty unless requested */
+    TerminationReason termination = TerminationReason::RESIDUAL;    /* Criterion that stopped the iteration */
+
+    /* Heap bytes held by the scores and the history */
+    size_t memory_usage() const
+    {
+        return buffer_bytes(pagerank_vector) + buffer_bytes(cheirank_vector) + buffer_bytes(convergence_history);
+    }
+};
+
+/* Heap bytes held by a Graph, by what they are for */
+struct MemoryUsage {
+    size_t structure = 0;       /* Edge lists, sparse storage and degrees */
+    size_t labels = 0;          /* Node label strings */
+    size_t index = 0;           /* Label to index lookup */
+    size_t caches = 0;          /* Statistics, adjacency bits and reduction, rebuilt on demand */
+
+    size_t total() const { return structure + labels + index + caches; }
+};
+
+struct PageRankOptions {
+    Solver solver = Solver::AUTO;                       /* Matrix representation to iterate over */
+    ConvergenceNorm norm = ConvergenceNorm::L1;         /* Norm of the residual compared against EPSILON */
+    size_t check_every = 1;                             /* Measure the residual every k iterations */
+    bool in_place = false;                              /* Gauss-Seidel sweep over a single vector */
+    Summation summation = Summation::NAIVE;             /* Summation mode for every reduction */
+    size_t renormalize_every = 0;                       /* Rescale the vector to sum 1 every k iterations (0 = never) */
+    Prefetch prefetch = Prefetch::AUTO;                 /* Prefetch gathered scores in the sparse kernel */
+    size_t prefetch_distance = 16;                      /* How many edges ahead to prefetch */
+    DanglingPolicy dangling = DanglingPolicy::UNIFORM;  /* Where the score of dangling nodes goes */
+    std::map<std::string, double> personalization;      /* Teleport weight per node, uniform when empty */
+    Precision precision = Precision::DOUBLE;            /* Score storage in the sparse solver */
+    size_t num_threads = 0;                             /* Threads of the sparse and dense solvers (0 = by graph size) */
+    size_t num_blocks = 0;                              /* Coarse blocks of the aggregation solver (0 = by edge count, at most 256) */
+    Acceleration acceleration = Acceleration::NONE;     /* Extrapolate Jacobi steps of the sparse solver */
+    bool reduce = false;                                /* Peel trees and contract chains before a sparse solve */
+    bool cheirank = false;                              /* Also rank the transposed graph, in the same traversal */
+    size_t top_k = 0;                                   /* Also stop once the k highest scores settle (0 = never) */
+    size_t top_k_stable = 2;                            /* Measurements in a row their order must repeat (0 = 1) */
+    double top_k_margin = 1.0;                          /* Lead of the k-th score over the next, in last changes */
+
+    TopKCriterion top_k_criterion() const { return TopKCriterion{top_k, top_k_stable, top_k_margin}; }
+};
+
+/* Mutex of one Graph; a copied or moved Graph gets a fresh, unlocked one of its own */
+struct GraphMutex {
+    std::mutex mutex;
+
+    GraphMutex() = default;
+    GraphMutex(const GraphMutex&) {}
+    GraphMutex& operator=(const GraphMutex&) { return *this; }
 };
 
 class Graph {
     private:
         /* Member Variables */
-        std::vector<std::vector<int>> adj;          /* Adjacency Matrix */
-        std::map<std::string, int> node_to_index;   /* Maps Node to Index in Adjacency Matrix */
-        std::vector<std::string> index_to_node;     /* Maps Index in Adjacency Matrix to Node */
-        std::vector<std::pair<std::string, std::string>> edges; /* List of Edges */
+        LabelIndex label_index;                     /* Maps Node to Index */
+        std::vector<std::string> index_to_node;     /* Maps Index to Node */
+        pr_vector<int> edge_src;                    /* Source index of every added edge, in insertion order */
+        pr_vector<int> edge_dest;                   /* Destination index of every added edge */
+        pr_vector<double> edge_weight;              /* Weight of every added edge, empty while all are 1 */
         size_t num_nodes = 0; 
+
+        /* Sparse Storage, rebuilt lazily after the graph changes */
+        CSR in_links;                               /* Row v holds the sources u of every edge u -> v */
+        pr_vector<int> out_degrees;                 /* Number of distinct out-links of each node */
+        pr_vector<double> inv_out_degrees;          /* 1 / (weighted) out-degree, 0 for dangling nodes */
+        GraphStats stats;                           /* Statistics of the current sparse storage */
+        bool sparse_dirty = true;
+        bool structure_dirty = true;                /* Reciprocity and SCCs of stats not computed yet */
+        GraphReduction reduction;                   /* Peeled and contracted structure, built on first use */
+        bool reduction_dirty = true;
+
+        size_t memory_budget = 0;                   /* Bytes the graph and its solves may use, 0 = unlimited */
+
+        mutable GraphMutex access;                  /* Held by callers sharing the graph across threads */
+
+        /* Dense Storage, only materialized by the bitset solver */
+        BitMatrix adj_bits;                         /* Adjacency of unweighted graphs, row v marks v's sources */
          
         /* PageRank Parameters */
         const double ALPHA = 0.75;      /* Damping Factor for Transition Matrix */
@@ -28,24 +165,75 @@ class Graph {
         const double EPSILON = 1e-6;    /* Convergence Threshold */
         
         /* Helper Functions */
-        void compute_out_degrees(std::vector<int>& out_degrees);
-        std::vector<std::vector<double>> build_transition_matrix();
-        std::vector<std::vector<double>> build_teleportation_matrix();
-        std::vector<std::vector<double>> build_google_matrix();
-        double compute_difference(const std::vector<double>& r_old, const std::vector<double>& r_new);
+        void build_sparse();
+        void build_sparse(size_t threads);
+        SparseProblem prepare_sparse(const PageRankOptions& options);
+        void finish_sparse(size_t threads);
+        void fill_teleport_vector(const PageRankOptions& options, double* teleport) const;
+        pr_vector<double> build_teleport_vector(const PageRankOptions& options) const;
+        DenseMatrix build_google_matrix(const PageRankOptions& options, size_t threads);
+
+        /* Solvers */
+        PageRankOptions plan_solve(const PageRankOptions& options);
+        static bool can_lump(const PageRankOptions& options);
+        struct PageRankResult solve_dense(const PageRankOptions& options);
+        struct PageRankResult solve_sparse(const PageRankOptions& options);
+        struct PageRankResult solve_small(const PageRankOptions& options);
+        struct PageRankResult solve_lumped(const PageRankOptions& options);
+        struct PageRankResult solve_aggregation(const PageRankOptions& options);
+        const GraphReduction& get_reduction();
+        struct PageRankResult solve_reduced(const PageRankOptions& options);
+        struct PageRankResult solve_cheirank(const PageRankOptions& options);
+        const BitMatrix& get_adjacency_bits();
+        bool adjacency_bits_fit() const;
+        struct PageRankResult solve_bitset(const PageRankOptions& options);
 
     public:
         Graph() {};
        
         /* Graph Manipulation Functions */
         void add_node(const std::string& lbl);
-        void add_edge(const std::string& from, const std::string& to);
+        void add_edge(const std::string& from, const std::string& to, double weight = 1.0);
+
+        /* Bulk Label Functions, hashing on every thread */
+        void add_nodes(const std::vector<std::string_view>& labels);
+        void resolve_labels(const std::vector<std::string_view>& labels, int64_t* indices) const;
+        size_t add_edges_by_label(const std::vector<std::string_view>& src, const std::vector<std::string_view>& dest);
+        void finalize();    /* Builds the sparse storage now instead of on the first solve */
+
+        /* Memory Guardrails */
+        static size_t estimate_memory(size_t num_nodes, size_t num_edges, size_t label_bytes = 0, bool weighted = false);
+        static size_t dense_memory(size_t num_nodes);
+        void reserve(size_t num_nodes, size_t num_edges, size_t label_bytes = 0, bool weighted = false);
+        void set_memory_budget(size_t bytes) { this->memory_budget = bytes; }
+        size_t get_memory_budget() const { return this->memory_budget; }
+
+        /* Induced subgraph on the given labels, unknown labels are ignored */
+        Graph subgraph(const std::vector<std::string_view>& labels);
 
         /* Getters */
-        std::vector<std::pair<std::string, std::string>> get_edges() const { return this->edges; } 
+        std::vector<std::pair<std::string, std::string>> get_edges() const;
         std::vector<std::string> get_nodes() const { return this->index_to_node; }
         size_t get_num_nodes() const { return this->num_nodes; }
+        bool is_weighted() const { return !this->edge_weight.empty(); }
+        const GraphStats& get_statistics();
+        MemoryUsage memory_usage() const;
+
+        /* Monte Carlo index answering Personalized PageRank queries from any single seed */
+        FingerprintIndex build_fingerprint_index(const FingerprintOptions& options = FingerprintOptions());
 
         /* High-Level Function to Compute PageRank */
         struct PageRankResult compute_pagerank(); 
+        struct PageRankResult compute_pagerank(const PageRankOptions& options);
+
+        /*
+         * Graph methods are not synchronized: every call, even a solve, may
+         * rebuild cached storage. Callers that share a Graph across threads
+         * hold this mutex around each call, as the Python bindings do.
+         */
+        std::mutex& get_mutex() const { return this->access.mutex; }
+
+        /* Many small graphs in one block-diagonal solve, one result per graph in order */
+        static std::vector<PageRankResult> solve_batch(const std::vector<Graph*>& graphs,
+                                                       const PageRankOptions& options = PageRankOptions());
 };
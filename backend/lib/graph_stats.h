@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "csr.h"
+#include "memory.h"
+
+/* Structural statistics of a graph, computed once per change and cached with it */
+struct GraphStats {
+    size_t num_nodes = 0;
+    size_t num_edges = 0;                       /* Distinct edges */
+    size_t num_dangling = 0;                    /* Nodes without out-links */
+    size_t num_sources = 0;                     /* Nodes without in-links */
+    size_t num_self_loops = 0;
+    size_t max_in_degree = 0;
+    size_t max_out_degree = 0;
+    double reciprocity = 0.0;                   /* Fraction of non-loop edges u -> v with v -> u, see below */
+    size_t num_sccs = 0;                        /* Strongly connected components, see below */
+    size_t largest_scc = 0;                     /* Nodes in the largest one, see below */
+    std::vector<size_t> in_degree_histogram;    /* [d] = number of nodes with in-degree d */
+    std::vector<size_t> out_degree_histogram;   /* [d] = number of nodes with out-degree d */
+    std::vector<int> dangling_nodes;            /* Indices of the dangling nodes, ascending */
+
+    double density() const
+    {
+        return num_nodes == 0 ? 0.0 : static_cast<double>(num_edges) / (static_cast<double>(num_nodes) * num_nodes);
+    }
+    double dangling_fraction() const
+    {
+        return num_nodes == 0 ? 0.0 : static_cast<double>(num_dangling) / num_nodes;
+    }
+};
+
+/*
+ * Single parallel pass over the in-link storage: degrees, histograms, dangling
+ * set and self-loops, which the solvers consult. Leaves the structure fields
+ * (reciprocity, SCCs) at zero.
+ */
+GraphStats compute_graph_stats(const CSR& in_links, const pr_vector<int>& out_degrees, size_t num_threads);
+
+/*
+ * Fills the structure fields: a parallel reciprocity pass, one search per
+ * edge, then a serial linear-time SCC decomposition. No solver needs them,
+ * so they are computed only when the statistics are asked for.
+ */
+void compute_structure_stats(const CSR& in_links, GraphStats& stats, size_t num_threads);
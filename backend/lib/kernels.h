@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "convergence.h"
+#include "csr.h"
+#include "summation.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define PR_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+    #define PR_PREFETCH(addr) ((void)(addr))
+#endif
+
+/* Number of set bits, a single instruction where the target has one */
+inline size_t popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(x));
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<size_t>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/*
+ * Features of a sparse solve that the per-edge loop depends on. Every
+ * combination is its own instantiation of the gather kernel, so the inner
+ * loop never tests them; everything decided per node or per step
+ * (personalization, self-loops, measuring, prefetching) is a runtime flag.
+ */
+template <typename Scalar_, bool Weighted_>
+struct KernelFeatures {
+    using Scalar = Scalar_;                         /* Storage type of the score vectors    */
+    static constexpr bool Weighted = Weighted_;     /* Per-edge weights in the CSR          */
+};
+
+/* Calls next(std::true_type) or next(std::false_type) */
+template <typename Next>
+inline auto branch(bool flag, Next&& next)
+{
+    return flag ? next(std::true_type{}) : next(std::false_type{});
+}
+
+/* Everything one gather step reads and writes */
+template <typename Scalar>
+struct GatherArgs {
+    const CSR* in_links;
+    Scalar* scaled;                 /* r / out-degree, the only array gathered at random    */
+    const double* inv_out_degrees;
+    const double* teleport;         /* Teleport vector when personalized, otherwise nullptr */
+    const double* dangling;         /* 1 for dangling nodes with self-loops, otherwise nullptr */
+    const Scalar* r_old;
+    Scalar* r_new;                  /* May alias r_old for an in-place sweep                */
+    double alpha;
+    double teleport_scale;          /* Mass distributed along the teleport vector           */
+    double base;                    /* Mass added to every node                             */
+    size_t distance;                /* Prefetch distance in edges                           */
+    bool prefetch;                  /* Prefetch the gathered scores                         */
+};
+
+/*
+ * Pre-scales every source score by its inverse out-degree, once per iteration:
+ *
+ *     scaled[u] = r[u] / out_degree(u)     (0 for dangling nodes)
+ *
+ * A contiguous n-length pass the compiler vectorizes, which takes the division
+ * out of the per-edge work of the gather below.
+ */
+template <typename Scalar>
+inline void prescale(const Scalar* r, const double* inv_out_degrees, Scalar* scaled, size_t n)
+{
+    for(size_t u = 0; u < n; u++)
+        scaled[u] = static_cast<Scalar>(r[u] * inv_out_degrees[u]);
+}
+
+/*
+ * Second-order extrapolation of a Jacobi step, in place in r_new:
+ *
+ *     r_new = r_prev + omega * (r_new - r_prev)
+ *
+ * The weights sum to one, so the total score is preserved.
+ */
+template <typename Scalar>
+inline void extrapolate(const Scalar* r_prev, Scalar* r_new, double omega, size_t n)
+{
+    for(size_t v = 0; v < n; v++)
+    {
+        double prev = static_cast<double>(r_prev[v]);
+        r_new[v] = static_cast<Scalar>(prev + omega * (static_cast<double>(r_new[v]) - prev));
+    }
+}
+
+/*
+ * Sparse gather step over the transposed graph:
+ *
+ *     r_new[v] = alpha * sum_{u -> v} w(u, v) * scaled[u]
+ *              + teleport_scale * teleport[v] + base
+ *              + alpha * r_old[v]              (dangling v, self-loop policy)
+ *
+ * The per-edge work is a pure gather-add. The sources u are effectively random,
+ * so on graphs larger than the cache every edge is a cache miss. With
+ * args.prefetch set, the scaled score of the source `distance` edges ahead is
+ * requested early so the misses overlap.
+ *
+ * With InPlace, r_new aliases r_old and each updated score is scaled back into
+ * `scaled` immediately, which turns the step into a Gauss-Seidel sweep.
+ *
+ * Only rows [begin, end) are updated, and measured when `measure` is set, so
+ * disjoint row ranges of a Jacobi step can run on different threads and merge
+ * their residuals after.
+ *
+ * Defined and instantiated once, in kernels.cpp, for every combination below.
+ */
+template <typename Features, bool InPlace, Summation S>
+Residual<S> gather_step(const GatherArgs<typename Features::Scalar>& args, size_t begin, size_t end, bool measure);
+
+#define PR_GATHER_STEP(PREFIX, SCALAR, WEIGHTED, IN_PLACE, SUMMATION)                                        \
+    PREFIX template Residual<SUMMATION> gather_step<KernelFeatures<SCALAR, WEIGHTED>, IN_PLACE, SUMMATION>(  \
+        const GatherArgs<SCALAR>&, size_t, size_t, bool);
+
+#define PR_GATHER_STEP_SUMMATIONS(PREFIX, SCALAR, WEIGHTED, IN_PLACE)       \
+    PR_GATHER_STEP(PREFIX, SCALAR, WEIGHTED, IN_PLACE, Summation::NAIVE)    \
+    PR_GATHER_STEP(PREFIX, SCALAR, WEIGHTED, IN_PLACE, Summation::KAHAN)    \
+    PR_GATHER_STEP(PREFIX, SCALAR, WEIGHTED, IN_PLACE, Summation::PAIRWISE)
+
+#define PR_GATHER_STEPS(PREFIX)                                     \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, double, false, false)         \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, double, false, true)          \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, double, true, false)          \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, double, true, true)           \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, float, false, false)          \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, float, false, true)           \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, float, true, false)           \
+    PR_GATHER_STEP_SUMMATIONS(PREFIX, float, true, true)
+
+PR_GATHER_STEPS(extern)
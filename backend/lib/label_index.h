@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Open-addressing hash index from node label to node index.
+ * A slot holds only the label's hash and its node index; the label itself is
+ * compared against the graph's index_to_node, so every label is stored once.
+ * Hashing is separate from probing so bulk paths can hash on many threads.
+ */
+class LabelIndex {
+    private:
+        struct Slot {
+            uint64_t hash;
+            int index;      /* EMPTY while the slot is unused */
+        };
+        static constexpr int EMPTY = -1;
+
+        std::vector<Slot> slots;    /* Power-of-two sized, at most half full */
+        size_t count = 0;
+
+        void rehash(size_t capacity);
+
+    public:
+        static uint64_t hash(std::string_view label);
+
+        /* Index of `label` (whose hash is `h`), or -1 when it is not present */
+        int find(std::string_view label, uint64_t h, const std::vector<std::string>& labels) const;
+        int find(std::string_view label, const std::vector<std::string>& labels) const
+        {
+            return find(label, hash(label), labels);
+        }
+
+        /*
+         * find() for a batch of labels. Each probe is up to three dependent cache
+         * misses (slot, label object, label bytes), so a group of lookups walks
+         * those stages together with every load of a stage prefetched first.
+         */
+        void find_batch(const std::string_view* batch, size_t count, int64_t* indices,
+                        const std::vector<std::string>& labels) const;
+
+        /* Adds a label that is known not to be present yet */
+        void insert(uint64_t h, int index);
+        void reserve(size_t num_labels);
+
+        size_t size() const { return count; }
+        size_t memory_bytes() const { return slots.capacity() * sizeof(Slot); }
+
+        /* Upper bound on memory_bytes() once `num_labels` labels are present */
+        static size_t estimate_bytes(size_t num_labels) { return 4 * num_labels * sizeof(Slot); }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/* Size of an x86-64 / AArch64 huge page */
+constexpr size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+
+/* How large buffers are backed */
+enum class HugePageMode {
+    OFF,            /* Regular pages, whatever the kernel does by default       */
+    TRANSPARENT,    /* 2 MB aligned mapping + madvise(MADV_HUGEPAGE)            */
+    EXPLICIT        /* MAP_HUGETLB from the reserved pool, TRANSPARENT fallback */
+};
+
+void set_huge_page_mode(HugePageMode mode);
+HugePageMode get_huge_page_mode();
+
+/* Size of the last-level cache in bytes, read once from the OS */
+size_t last_level_cache_size();
+
+/*
+ * Allocation of buffers of at least HUGE_PAGE_SIZE bytes: page-mapped under
+ * TRANSPARENT and EXPLICIT, from operator new under OFF. Each block remembers
+ * how it was allocated and how many bytes it was recorded as, so it is
+ * released and accounted the same way however the mode changed since.
+ */
+void* allocate_pages(size_t bytes);
+void deallocate_pages(void* ptr, size_t bytes) noexcept;
+
+/* Bytes a PageAllocator block of `bytes` allocated now occupies, page-mapped blocks are rounded up */
+size_t allocation_size(size_t bytes);
+
+/* Process-wide bytes held in PageAllocator blocks right now, and the most ever held at once */
+size_t allocated_bytes();
+size_t peak_allocated_bytes();
+void reset_peak_allocated_bytes();
+void record_allocation(size_t bytes) noexcept;
+void record_deallocation(size_t bytes) noexcept;
+
+/*
+ * Allocator for the graph storage and solver buffers. Blocks below
+ * HUGE_PAGE_SIZE always come from operator new; larger ones go through
+ * allocate_pages(), which records them itself.
+ */
+template <typename T>
+struct PageAllocator {
+    using value_type = T;
+
+    PageAllocator() noexcept = default;
+    template <typename U>
+    PageAllocator(const PageAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if(bytes >= HUGE_PAGE_SIZE)
+            return static_cast<T*>(allocate_pages(bytes));
+
+        T* ptr = static_cast<T*>(::operator new(bytes));
+        record_allocation(bytes);
+        return ptr;
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        size_t bytes = n * sizeof(T);
+        if(bytes >= HUGE_PAGE_SIZE)
+        {
+            deallocate_pages(ptr, bytes);
+            return;
+        }
+
+        ::operator delete(ptr);
+        record_deallocation(bytes);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PageAllocator<T>&, const PageAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const PageAllocator<T>&, const PageAllocator<U>&) { return false; }
+
+/* Vector whose large buffers may be backed by huge pages */
+template <typename T>
+using pr_vector = std::vector<T, PageAllocator<T>>;
+
+/* Heap bytes held by a vector's buffer */
+template <typename T>
+size_t buffer_bytes(const pr_vector<T>& v)
+{
+    return v.capacity() == 0 ? 0 : allocation_size(v.capacity() * sizeof(T));
+}
+
+template <typename T>
+size_t buffer_bytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/* Upper bound on worker threads for every parallel pass, 0 = hardware concurrency */
+inline std::atomic<size_t> max_threads_setting{0};
+
+inline void set_max_threads(size_t num_threads)
+{
+    max_threads_setting.store(num_threads, std::memory_order_relaxed);
+}
+
+inline size_t get_max_threads()
+{
+    size_t setting = max_threads_setting.load(std::memory_order_relaxed);
+    if(setting != 0)
+        return setting;
+
+    size_t hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+/* Thread count for `work` units when each thread should get at least `min_work_per_thread` */
+inline size_t threads_for(size_t work, size_t min_work_per_thread)
+{
+    size_t wanted = work / std::max<size_t>(min_work_per_thread, 1);
+    return std::max<size_t>(1, std::min(wanted, get_max_threads()));
+}
+
+/*
+ * Threads that stay up across the parallel passes of a solve, so a pass wakes
+ * them instead of starting and joining one thread per chunk. Worker w runs
+ * chunk w + 1 of every pass and the calling thread runs chunk 0. Workers are
+ * started by the first pass that needs them and stopped with the pool; only
+ * the thread that owns the pool runs passes on it.
+ */
+class WorkerPool {
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;       /* A pass was posted, or the pool stops */
+        std::condition_variable finished;   /* The last worker is done with the pass */
+        const std::function<void(size_t)>* job = nullptr;
+        size_t num_chunks = 0;
+        size_t passes = 0;                  /* Passes posted so far */
+        size_t pending = 0;                 /* Workers not done with the current pass */
+        bool stopping = false;
+        bool running = false;               /* A pass is in progress, read by the owner only */
+
+        void work(size_t w, size_t seen)
+        {
+            for(;;)
+            {
+                const std::function<void(size_t)>* fn;
+                size_t chunks;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&]() { return stopping || passes != seen; });
+                    if(stopping)
+                        return;
+                    seen   = passes;
+                    fn     = job;
+                    chunks = num_chunks;
+                }
+
+                if(w + 1 < chunks)
+                    (*fn)(w + 1);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--pending == 0)
+                    finished.notify_one();
+            }
+        }
+
+    public:
+        WorkerPool() = default;
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(std::thread& worker : workers)
+                worker.join();
+        }
+
+        bool is_running() const { return running; }
+
+        /* Calls fn(t) for every chunk t < chunks and returns once all are done; fn must not throw */
+        void run(size_t chunks, const std::function<void(size_t)>& fn)
+        {
+            /* A worker that cannot be started leaves its chunk to the calling thread */
+            try
+            {
+                while(workers.size() + 1 < chunks)
+                {
+                    size_t w = workers.size();
+                    workers.emplace_back(&WorkerPool::work, this, w, passes);
+                }
+            }
+            catch(const std::system_error&) {}
+
+            running = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job        = &fn;
+                num_chunks = chunks;
+                pending    = workers.size();
+                passes++;
+            }
+            wake.notify_all();
+
+            fn(0);
+            for(size_t t = workers.size() + 1; t < chunks; t++)
+                fn(t);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return pending == 0; });
+            running = false;
+        }
+};
+
+/* Pool of the solve running on this thread, nullptr outside one */
+inline thread_local WorkerPool* current_pool = nullptr;
+
+/*
+ * Keeps a WorkerPool for every parallel pass the calling thread makes while
+ * the scope lives, one per solve. An inner scope reuses the outer one's pool.
+ */
+class WorkerScope {
+    private:
+        std::unique_ptr<WorkerPool> pool;
+
+    public:
+        WorkerScope()
+        {
+            if(current_pool == nullptr)
+            {
+                pool = std::make_unique<WorkerPool>();
+                current_pool = pool.get();
+            }
+        }
+        ~WorkerScope()
+        {
+            if(pool)
+                current_pool = nullptr;
+        }
+        WorkerScope(const WorkerScope&) = delete;
+        WorkerScope& operator=(const WorkerScope&) = delete;
+};
+
+/*
+ * Calls fn(t, splits[t], splits[t + 1]) for every chunk t, one thread per chunk.
+ * The calling thread runs chunk 0; with one chunk no thread is started at all.
+ * Inside a WorkerScope the chunks run on its pool, otherwise (and for passes
+ * nested in a chunk) on threads started for this call. The first exception a
+ * chunk throws, in chunk order, is rethrown once every chunk is done.
+ */
+template <typename Fn>
+inline void parallel_ranges(const std::vector<size_t>& splits, Fn&& fn)
+{
+    size_t num_chunks = splits.empty() ? 0 : splits.size() - 1;
+    if(num_chunks <= 1)
+    {
+        if(num_chunks == 1)
+            fn(size_t{0}, splits[0], splits[1]);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(num_chunks);
+    auto chunk = [&](size_t t) {
+        try
+        {
+            fn(t, splits[t], splits[t + 1]);
+        }
+        catch(...)
+        {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    WorkerPool* pool = current_pool;
+    if(pool != nullptr && !pool->is_running())
+    {
+        pool->run(num_chunks, chunk);
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(num_chunks - 1);
+
+        size_t t = 1;
+        try
+        {
+            for(; t < num_chunks; t++)
+                workers.emplace_back(chunk, t);
+        }
+        catch(const std::system_error&) {}
+
+        /* Chunks whose thread could not be started run here */
+        chunk(0);
+        for(; t < num_chunks; t++)
+            chunk(t);
+
+        for(auto& worker : workers)
+            worker.join();
+    }
+
+    for(const std::exception_ptr& error : errors)
+        if(error)
+            std::rethrow_exception(error);
+}
+
+/* Boundaries of `num_chunks` equal contiguous chunks of [0, count) */
+inline std::vector<size_t> even_splits(size_t count, size_t num_chunks)
+{
+    num_chunks = std::max<size_t>(1, std::min(num_chunks, count));
+    std::vector<size_t> splits(num_chunks + 1);
+    for(size_t t = 0; t <= num_chunks; t++)
+        splits[t] = count * t / num_chunks;
+    return splits;
+}
+
+/*
+ * Splits [0, count) into one contiguous chunk per thread and calls
+ * fn(thread_id, begin, end) for each. Chunk t always covers lower indices than
+ * chunk t + 1, so per-thread results can be concatenated in order.
+ */
+template <typename Fn>
+inline void parallel_for(size_t count, size_t num_threads, Fn&& fn)
+{
+    if(count == 0)
+    {
+        fn(size_t{0}, size_t{0}, size_t{0});
+        return;
+    }
+    parallel_ranges(even_splits(count, num_threads), fn);
+}
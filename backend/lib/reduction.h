@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "csr.h"
+#include "memory.h"
+
+/* Where a node ended up in the reduction */
+enum class NodeRole : unsigned char {
+    CORE,           /* Solved iteratively                                       */
+    UPSTREAM,       /* Reached by no cycle: fixed before the solve              */
+    DOWNSTREAM,     /* Reaches no cycle: follows from the others after it       */
+    ELIMINATED      /* One core in- and out-neighbour: substituted into them    */
+};
+
+/*
+ * Elimination of a node c with core in-neighbour `source` and out-neighbour
+ * `target`. With b_c its constant once eliminated,
+ *
+ *     y_c = coefficient * y_source + scale * b_c,     b_target += flow * b_c
+ */
+struct Substitution {
+    int node;
+    int source;
+    int target;
+    double coefficient;
+    double scale;
+    double flow;
+};
+
+/*
+ * The graph with its acyclic fringes peeled and its chains contracted, for
+ * the linear system of the scores before normalization
+ *
+ *     y_v = sum_{u -> v} M[v][u] y_u + b_v,       M[v][u] = alpha * w(u, v) / out(u)
+ *
+ * Only the structure is kept: b depends on the teleport vector and is
+ * replayed through it on every solve. Cached with the sparse storage.
+ */
+struct GraphReduction {
+    std::vector<NodeRole> roles;
+    std::vector<int> upstream_order;            /* Sources first */
+    std::vector<int> downstream_order;          /* Sinks first */
+    std::vector<Substitution> substitutions;    /* In elimination order */
+    std::vector<int> core;                      /* Surviving core nodes, ascending */
+    CSR core_in_links;                          /* M restricted to them, renumbered, columns normalized */
+    pr_vector<double> core_column_sums;         /* Share of each one's score M keeps in the core */
+};
+
+/* Peels and contracts the graph of `in_links`; linear in its size */
+GraphReduction reduce_graph(const CSR& in_links, const pr_vector<double>& inv_out_degrees,
+                            const pr_vector<int>& out_degrees, double alpha);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "convergence.h"
+#include "csr.h"
+#include "graph.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "summation.h"
+
+/* Inputs of a sparse solve, shared by every kernel instantiation and every solver on the in-links */
+struct SparseProblem {
+    const CSR* in_links;
+    const double* inv_out_degrees;
+    const std::vector<int>* dangling_nodes;
+    pr_vector<double> teleport;         /* Normalized teleport vector, used when personalized */
+    pr_vector<double> dangling_flags;   /* 1 for dangling nodes, used with self-loops         */
+    std::vector<size_t> row_splits;     /* Row range of each thread, one range in place       */
+    size_t num_nodes;
+    double alpha;
+    double epsilon;
+    size_t max_iter;
+    bool prefetch;                      /* Prefetch gathered scores in the gather kernel      */
+};
+
+/*
+ * Calls next(KernelFeatures<...>{}) with the features of the solve, the
+ * precision and edge weights resolved once into their own instantiation.
+ */
+template <typename Next>
+inline auto dispatch_features(const SparseProblem& problem, const PageRankOptions& options, Next&& next)
+{
+    bool use_float = (options.precision == Precision::FLOAT);
+    bool weighted  = problem.in_links->is_weighted();
+
+    return branch(use_float, [&](auto f) {
+        return branch(weighted, [&](auto w) {
+            using Scalar = std::conditional_t<decltype(f)::value, float, double>;
+            return next(KernelFeatures<Scalar, decltype(w)::value>{});
+        });
+    });
+}
+
+/* Scale of the teleport vector and uniform share every node gets in a step */
+struct TeleportTerms {
+    double scale;   /* Multiplies the teleport vector, when personalized */
+    double base;    /* Added to every node */
+};
+
+/*
+ * Splits the teleport mass and `dangling_mass` (the score on dangling nodes)
+ * between the teleport vector and a uniform share, as the dangling policy
+ * says. Without personalization the teleport vector is uniform too, so
+ * everything goes into the base.
+ */
+inline TeleportTerms teleport_terms(const PageRankOptions& options, double alpha, double dangling_mass, size_t n)
+{
+    double uniform_share = (options.dangling == DanglingPolicy::UNIFORM) ? alpha * dangling_mass : 0.0;
+    double teleport_mass = (1.0 - alpha) + alpha * dangling_mass - uniform_share;
+    if(!options.personalization.empty())
+        return TeleportTerms{teleport_mass, uniform_share / static_cast<double>(n)};
+    else
+        return TeleportTerms{0.0, (teleport_mass + uniform_share) / static_cast<double>(n)};
+}
+
+/*
+ * One power step r_new = G r_old over the in-links, split across the row
+ * ranges of the problem: the dangling mass is collected, split between the
+ * teleport vector and a uniform share, every source score is pre-scaled, and
+ * each thread gathers its own rows. The partial residuals merge in row order.
+ *
+ * In place, r_new is r_old and the step is a Gauss-Seidel sweep, which does
+ * not preserve the sum; the caller renormalizes or swaps afterwards.
+ */
+template <typename Features, Summation S>
+inline double power_step(const SparseProblem& problem, const PageRankOptions& options,
+                         GatherArgs<typename Features::Scalar>& args, bool measure,
+                         typename Features::Scalar* r_old, typename Features::Scalar* r_new)
+{
+    const size_t n = problem.num_nodes;
+    const double alpha = problem.alpha;
+
+    /* Mass leaving dangling nodes this iteration */
+    double dangling_mass = 0.0;
+    if(options.dangling != DanglingPolicy::SELF_LOOP)
+    {
+        Accumulator<S> dangling;
+        for(int u : *problem.dangling_nodes)
+            dangling.add(static_cast<double>(r_old[u]));
+        dangling_mass = dangling.value();
+    }
+
+    TeleportTerms terms = teleport_terms(options, alpha, dangling_mass, n);
+    args.teleport_scale = terms.scale;
+    args.base           = terms.base;
+
+    const std::vector<size_t>& splits = problem.row_splits;
+    parallel_ranges(splits, [&](size_t, size_t begin, size_t end) {
+        prescale(r_old + begin, problem.inv_out_degrees + begin, args.scaled + begin, end - begin);
+    });
+
+    args.r_old = r_old;
+    args.r_new = r_new;
+    const bool in_place = (r_old == r_new);
+
+    /* Each thread updates its own rows; the residuals merge in row order */
+    std::vector<Residual<S>> partial(splits.size() - 1);
+    parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+        partial[t] = in_place ? gather_step<Features, true, S>(args, begin, end, measure)
+                              : gather_step<Features, false, S>(args, begin, end, measure);
+    });
+
+    Residual<S> residual;
+    for(const Residual<S>& part : partial)
+        residual.merge(part);
+    return residual.value(options.norm);
+}
+
+/* Gather arguments that stay fixed over a solve, with `scaled` as the pre-scaled score buffer */
+template <typename Scalar>
+inline GatherArgs<Scalar> gather_args(const SparseProblem& problem, const PageRankOptions& options, Scalar* scaled)
+{
+    GatherArgs<Scalar> args;
+    args.in_links        = problem.in_links;
+    args.scaled          = scaled;
+    args.inv_out_degrees = problem.inv_out_degrees;
+    args.teleport        = options.personalization.empty() ? nullptr : problem.teleport.data();
+    args.dangling        = (options.dangling == DanglingPolicy::SELF_LOOP) ? problem.dangling_flags.data() : nullptr;
+    args.alpha           = problem.alpha;
+    args.distance        = std::max<size_t>(options.prefetch_distance, 1);
+    args.prefetch        = problem.prefetch;
+    return args;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#ifdef __FAST_MATH__
+    #warning "-ffast-math lets the compiler reassociate away the Kahan compensation terms"
+#endif
+
+/*
+ * Summation mode used by every reduction in the solver (row dot products,
+ * residuals and renormalization). With tens of millions of nodes each score
+ * is ~1e-8 and plain left-to-right summation loses enough precision for the
+ * residual to stall above EPSILON.
+ */
+enum class Summation {
+    NAIVE,      /* Plain left-to-right summation                   */
+    KAHAN,      /* Kahan compensated summation                     */
+    PAIRWISE    /* Blocked pairwise (cascade) summation, O(log n)  */
+};
+
+/* Streaming accumulators, one element at a time */
+struct NaiveAccumulator {
+    double sum = 0.0;
+
+    inline void add(double x) { sum += x; }
+    inline double value() const { return sum; }
+};
+
+struct KahanAccumulator {
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    inline void add(double x)
+    {
+        double y = x - compensation;
+        double t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+    }
+    inline double value() const { return sum; }
+};
+
+/*
+ * Pairwise summation over a stream: blocks of BLOCK values are summed naively,
+ * then block sums are merged like a binary counter so that every partial sum
+ * only ever meets a partial sum of the same size.
+ */
+struct PairwiseAccumulator {
+    static constexpr size_t BLOCK  = 128;
+    static constexpr size_t LEVELS = 64;
+
+    double block = 0.0;
+    size_t block_fill = 0;
+    size_t num_blocks = 0;
+    double levels[LEVELS] = {};
+
+    inline void add(double x)
+    {
+        block += x;
+        if(++block_fill == BLOCK)
+            flush();
+    }
+
+    inline void flush()
+    {
+        double carry = block;
+        size_t level = 0;
+        while(num_blocks & (size_t{1} << level))
+        {
+            carry += levels[level];
+            levels[level] = 0.0;
+            level++;
+        }
+        levels[level] = carry;
+        num_blocks++;
+        block = 0.0;
+        block_fill = 0;
+    }
+
+    inline double value() const
+    {
+        double total = block;
+        for(size_t level = 0; level < LEVELS; level++)
+            total += levels[level];
+        return total;
+    }
+};
+
+template <Summation S>
+using Accumulator = std::conditional_t<S == Summation::KAHAN, KahanAccumulator,
+                    std::conditional_t<S == Summation::PAIRWISE, PairwiseAccumulator, NaiveAccumulator>>;
+
+/*
+ * Dot product of two contiguous arrays under summation mode S.
+ * Each mode keeps LANES independent accumulators so the loop can be vectorized;
+ * the compensated modes stay cheap because the lanes hide the dependency chain.
+ */
+template <Summation S>
+inline double dot(const double* a, const double* b, size_t n)
+{
+    constexpr size_t LANES = 4;
+
+    if constexpr (S == Summation::PAIRWISE)
+    {
+        constexpr size_t BASE = 128;
+        if(n > BASE)
+        {
+            size_t half = (n / 2) & ~(LANES - 1);
+            return dot<S>(a, b, half) + dot<S>(a + half, b + half, n - half);
+        }
+    }
+
+    double sum[LANES] = {};
+    double comp[LANES] = {};
+    size_t i = 0;
+
+    for(; i + LANES <= n; i += LANES)
+    {
+        for(size_t lane = 0; lane < LANES; lane++)
+        {
+            double x = a[i + lane] * b[i + lane];
+            if constexpr (S == Summation::KAHAN)
+            {
+                double y = x - comp[lane];
+                double t = sum[lane] + y;
+                comp[lane] = (t - sum[lane]) - y;
+                sum[lane] = t;
+            }
+            else
+            {
+                sum[lane] += x;
+            }
+        }
+    }
+
+    Accumulator<S> total;
+    for(size_t lane = 0; lane < LANES; lane++)
+    {
+        total.add(sum[lane]);
+        if constexpr (S == Summation::KAHAN)
+            total.add(-comp[lane]);
+    }
+    for(; i < n; i++)
+        total.add(a[i] * b[i]);
+
+    return total.value();
+}
+
+/*
+ * Dot products of ROWS consecutive matrix rows, `stride` apart, with the same
+ * vector b: out[k] = dot<S>(a + k * stride, b, n). Each element of b is loaded
+ * once for all ROWS rows, and the ROWS x LANES accumulators stay in registers.
+ * Every row is summed lane by lane exactly as dot<S> sums it.
+ */
+template <Summation S, size_t ROWS>
+inline void dot_rows(const double* a, size_t stride, const double* b, size_t n, double* out)
+{
+    constexpr size_t LANES = 4;
+
+    if constexpr (S == Summation::PAIRWISE)
+    {
+        constexpr size_t BASE = 128;
+        if(n > BASE)
+        {
+            size_t half = (n / 2) & ~(LANES - 1);
+            double low[ROWS], high[ROWS];
+            dot_rows<S, ROWS>(a, stride, b, half, low);
+            dot_rows<S, ROWS>(a + half, stride, b + half, n - half, high);
+            for(size_t row = 0; row < ROWS; row++)
+                out[row] = low[row] + high[row];
+            return;
+        }
+    }
+
+    double sum[ROWS][LANES] = {};
+    double comp[ROWS][LANES] = {};
+    size_t i = 0;
+
+    for(; i + LANES <= n; i += LANES)
+    {
+        for(size_t row = 0; row < ROWS; row++)
+        {
+            const double* a_row = a + row * stride;
+            for(size_t lane = 0; lane < LANES; lane++)
+            {
+                double x = a_row[i + lane] * b[i + lane];
+                if constexpr (S == Summation::KAHAN)
+                {
+                    double y = x - comp[row][lane];
+                    double t = sum[row][lane] + y;
+                    comp[row][lane] = (t - sum[row][lane]) - y;
+                    sum[row][lane] = t;
+                }
+                else
+                {
+                    sum[row][lane] += x;
+                }
+            }
+        }
+    }
+
+    for(size_t row = 0; row < ROWS; row++)
+    {
+        const double* a_row = a + row * stride;
+        Accumulator<S> total;
+        for(size_t lane = 0; lane < LANES; lane++)
+        {
+            total.add(sum[row][lane]);
+            if constexpr (S == Summation::KAHAN)
+                total.add(-comp[row][lane]);
+        }
+        for(size_t j = i; j < n; j++)
+            total.add(a_row[j] * b[j]);
+        out[row] = total.value();
+    }
+}
+
+/* Sum of a contiguous array under summation mode S */
+template <Summation S, typename T>
+inline double sum(const T* a, size_t n)
+{
+    Accumulator<S> total;
+    for(size_t i = 0; i < n; i++)
+        total.add(static_cast<double>(a[i]));
+    return total.value();
+}
+
+/* Rescales r so that it sums to 1, undoing the drift of accumulated rounding */
+template <Summation S, typename T>
+inline void renormalize(T* r, size_t n)
+{
+    double total = sum<S>(r, n);
+    if(total <= 0.0)
+        return;
+
+    T scale = static_cast<T>(1.0 / total);
+    for(size_t i = 0; i < n; i++)
+        r[i] *= scale;
+}
@@ -0,0 +1,468 @@
+#!/usr/bin/env python3
+
+import sys
+import time
+import random
+import argparse
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).parent.parent / 'pagerank'))
+
+import pagerank_cpp
+
+BYTES_PER_SCORE = 8
+
+
+def build_random_graph(num_nodes, edges_per_node, seed):
+    """Build a random directed graph with a fixed out-degree per node."""
+    rng = random.Random(seed)
+    g = pagerank_cpp.Graph()
+
+    labels = [str(i) for i in range(num_nodes)]
+    for lbl in labels:
+        g.add_node(lbl)
+
+    for src in labels:
+        for _ in range(edges_per_node):
+            g.add_edge(src, labels[rng.randrange(num_nodes)])
+
+    return g
+
+
+def time_solve(graph, options, repeats):
+    """Return the best wall time over `repeats` runs and the last result."""
+    best = float('inf')
+    result = None
+    for _ in range(repeats):
+        start = time.perf_counter()
+        result = graph.compute_pagerank(options)
+        best = min(best, time.perf_counter() - start)
+    return best, result
+
+
+def bench_buffers(graph, repeats):
+    """Double-buffer swapping vs. in-place Gauss-Seidel sweeps."""
+    n = graph.num_nodes()
+
+    print("\n" + "=" * 60)
+    print("Score vector buffering")
+    print("=" * 60)
+
+    double_buffer = pagerank_cpp.Options()
+    double_buffer.solver = pagerank_cpp.Solver.DENSE
+    t_swap, r_swap = time_solve(graph, double_buffer, repeats)
+
+    in_place = pagerank_cpp.Options()
+    in_place.solver = pagerank_cpp.Solver.DENSE
+    in_place.in_place = True
+    t_inplace, r_inplace = time_solve(graph, in_place, repeats)
+
+    # The previous solver copied r_new into r_old once per iteration: one read and one write of n scores
+    saved = r_swap.num_iterations * n * BYTES_PER_SCORE * 2
+    print(f"  double buffer : {t_swap * 1e3:9.2f} ms  {r_swap.num_iterations:4d} iterations")
+    print(f"  in place      : {t_inplace * 1e3:9.2f} ms  {r_inplace.num_iterations:4d} iterations")
+    print(f"  copy traffic saved by swapping: {saved / 2**20:.2f} MiB per solve")
+
+
+def bench_huge_pages(args):
+    """Default allocator vs. transparent and explicit huge pages."""
+    print("\n" + "=" * 60)
+    print("Huge page backed allocations")
+    print("=" * 60)
+
+    modes = [
+        ('default', pagerank_cpp.HugePageMode.OFF),
+        ('transparent', pagerank_cpp.HugePageMode.TRANSPARENT),
+        ('explicit', pagerank_cpp.HugePageMode.EXPLICIT),
+    ]
+    for name, mode in modes:
+        # Graph storage is allocated while building, so rebuild under each mode
+        pagerank_cpp.set_huge_page_mode(mode)
+        graph = build_random_graph(args.nodes, args.edges_per_node, args.seed)
+        options = pagerank_cpp.Options()
+        options.solver = pagerank_cpp.Solver.DENSE
+        t, result = time_solve(graph, options, args.repeats)
+        print(f"  {name:12s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations")
+
+    pagerank_cpp.set_huge_page_mode(pagerank_cpp.HugePageMode.OFF)
+
+
+def bench_prefetch(args):
+    """Sparse gather kernel with and without software prefetching."""
+    print("\n" + "=" * 60)
+    print(f"Gather prefetching ({args.large_nodes} nodes, larger than the LLC)")
+    print("=" * 60)
+
+    graph = build_random_graph(args.large_nodes, args.edges_per_node, args.seed)
+
+    for name, prefetch in [('off', pagerank_cpp.Prefetch.OFF), ('on', pagerank_cpp.Prefetch.ON)]:
+        options = pagerank_cpp.Options()
+        options.solver = pagerank_cpp.Solver.SPARSE
+        options.prefetch = prefetch
+        t, result = time_solve(graph, options, args.repeats)
+        print(f"  prefetch {name:4s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations")
+
+    for distance in [4, 8, 16, 32, 64]:
+        options = pagerank_cpp.Options()
+        options.solver = pagerank_cpp.Solver.SPARSE
+        options.prefetch = pagerank_cpp.Prefetch.ON
+        options.prefetch_distance = distance
+        t, _ = time_solve(graph, options, args.repeats)
+        print(f"  distance {distance:4d}: {t * 1e3:9.2f} ms")
+
+
+def bench_auto(args):
+    """Automatic solver choice against every explicit solver, across graph sizes."""
+    print("\n" + "=" * 60)
+    print("Automatic solver selection")
+    print("=" * 60)
+
+    for num_nodes in [12, args.nodes, args.large_nodes // 10]:
+        graph = build_random_graph(num_nodes, args.edges_per_node, args.seed)
+        print(f"  {num_nodes} nodes:")
+
+        for solver in [pagerank_cpp.Solver.AUTO, pagerank_cpp.Solver.DENSE, pagerank_cpp.Solver.SPARSE]:
+            if solver == pagerank_cpp.Solver.DENSE and num_nodes > args.nodes:
+                continue
+            options = pagerank_cpp.Options()
+            options.solver = solver
+            t, result = time_solve(graph, options, args.repeats)
+            sweep = "gauss-seidel" if result.in_place else "jacobi"
+            print(f"    {solver.name.lower():6s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations"
+                  f"  ran {result.solver.name.lower()}, {sweep}, {result.num_threads} threads")
+
+
+def bench_build(args):
+    """Sparse storage build time (counting-sort CSR plus statistics) against edge count."""
+    print("\n" + "=" * 60)
+    print("Sparse storage build")
+    print("=" * 60)
+
+    max_threads = pagerank_cpp.get_max_threads()
+    for num_nodes in [args.nodes * 10, args.nodes * 100, args.large_nodes]:
+        graph = build_random_graph(num_nodes, args.edges_per_node, args.seed)
+        num_edges = num_nodes * args.edges_per_node
+
+        for threads in sorted({1, max_threads}):
+            pagerank_cpp.set_max_threads(threads)
+            best = float('inf')
+            for repeat in range(args.repeats):
+                # Adding a node marks the storage stale so finalize() rebuilds it
+                graph.add_node(f"build-{threads}-{repeat}")
+                start = time.perf_counter()
+                graph.finalize()
+                best = min(best, time.perf_counter() - start)
+            rate = num_edges / best / 1e6
+            print(f"  {num_edges:10d} edges, {threads:2d} threads: {best * 1e3:9.2f} ms  {rate:7.1f} M edges/s")
+
+    pagerank_cpp.set_max_threads(0)
+
+
+def bench_lumped(args):
+    """Sparse solver against the lumped one as the share of dangling nodes grows."""
+    print("\n" + "=" * 60)
+    print("Dangling node lumping")
+    print("=" * 60)
+
+    num_nodes = args.large_nodes // 10
+    for dangling in [0.0, 0.3, 0.6]:
+        rng = random.Random(args.seed)
+        graph = pagerank_cpp.Graph()
+        labels = [str(i) for i in range(num_nodes)]
+        graph.add_nodes(labels)
+        sources = [lbl for lbl in labels if rng.random() >= dangling]
+        src = [lbl for lbl in sources for _ in range(args.edges_per_node)]
+        dest = [labels[rng.randrange(num_nodes)] for _ in src]
+        graph.add_edges_by_label(src, dest)
+        graph.finalize()
+
+        print(f"  {dangling:.0%} dangling:")
+        for solver in [pagerank_cpp.Solver.SPARSE, pagerank_cpp.Solver.LUMPED]:
+            options = pagerank_cpp.Options()
+            options.solver = solver
+            t, result = time_solve(graph, options, args.repeats)
+            print(f"    {solver.name.lower():6s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations")
+
+
+def bench_aggregation(args):
+    """Power iteration against aggregation/disaggregation on graphs of weakly linked communities."""
+    print("\n" + "=" * 60)
+    print("Aggregation/disaggregation")
+    print("=" * 60)
+
+    num_nodes = args.large_nodes // 10
+    num_communities = 64
+    community_size = num_nodes // num_communities
+    for crossing in [0.3, 0.01, 0.001]:
+        # Communities are contiguous in node order, which is what the coarse blocks follow
+        rng = random.Random(args.seed)
+        graph = pagerank_cpp.Graph()
+        labels = [str(i) for i in range(num_nodes)]
+        graph.add_nodes(labels)
+        src, dest = [], []
+        for u in range(num_nodes):
+            first = (u // community_size) * community_size
+            for _ in range(args.edges_per_node):
+                v = rng.randrange(num_nodes) if rng.random() < crossing else first + rng.randrange(community_size)
+                src.append(labels[u])
+                dest.append(labels[min(v, num_nodes - 1)])
+        graph.add_edges_by_label(src, dest)
+        graph.finalize()
+
+        print(f"  {crossing:.1%} of links leave their community:")
+        for solver in [pagerank_cpp.Solver.SPARSE, pagerank_cpp.Solver.AGGREGATION]:
+            options = pagerank_cpp.Options()
+            options.solver = solver
+            t, result = time_solve(graph, options, args.repeats)
+            print(f"    {solver.name.lower():11s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations")
+
+
+def bench_acceleration(args):
+    """Plain Jacobi steps against Chebyshev and momentum extrapolation, per dangling policy."""
+    print("\n" + "=" * 60)
+    print("Extrapolated power iteration")
+    print("=" * 60)
+
+    graph = build_random_graph(args.large_nodes // 10, args.edges_per_node, args.seed)
+    # A share of dangling nodes gives the self-loop policy its slow, real modes
+    graph.add_nodes([f"sink-{i}" for i in range(args.large_nodes // 100)])
+    graph.add_edges_by_label([str(i) for i in range(args.large_nodes // 100)],
+                             [f"sink-{i}" for i in range(args.large_nodes // 100)])
+
+    for policy in [pagerank_cpp.DanglingPolicy.UNIFORM, pagerank_cpp.DanglingPolicy.SELF_LOOP]:
+        print(f"  dangling {policy.name.lower()}:")
+        for acceleration in [pagerank_cpp.Acceleration.NONE, pagerank_cpp.Acceleration.CHEBYSHEV,
+                             pagerank_cpp.Acceleration.MOMENTUM]:
+            options = pagerank_cpp.Options()
+            options.solver = pagerank_cpp.Solver.SPARSE
+            options.dangling = policy
+            options.acceleration = acceleration
+            t, result = time_solve(graph, options, args.repeats)
+            print(f"    {acceleration.name.lower():9s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations")
+
+
+def bench_reduction(args):
+    """Sparse solver with and without peeling trees and contracting chains first."""
+    print("\n" + "=" * 60)
+    print("Tree and chain reduction")
+    print("=" * 60)
+
+    num_core = args.large_nodes // 20
+    for fringe in [0.0, 1.0, 4.0]:
+        # A random core, then per core node `fringe` chains, feeding trees and hanging trees
+        rng = random.Random(args.seed)
+        graph = build_random_graph(num_core, args.edges_per_node, args.seed)
+        core = [str(i) for i in range(num_core)]
+        src, dest = [], []
+        labels = []
+        for i in range(int(num_core * fringe)):
+            chain = [f"c{i}-{j}" for j in range(1 + rng.randrange(6))]
+            labels += chain + [f"t{i}", f"h{i}"]
+            path = [rng.choice(core)] + chain + [rng.choice(core)]
+            src += path[:-1] + [f"t{i}", rng.choice(core)]
+            dest += path[1:] + [rng.choice(core), f"h{i}"]
+        graph.add_nodes(labels)
+        graph.add_edges_by_label(src, dest)
+        graph.finalize()
+
+        print(f"  {graph.num_nodes()} nodes, {fringe:.0f} fringe structures per core node:")
+        for reduce in [False, True]:
+            options = pagerank_cpp.Options()
+            options.solver = pagerank_cpp.Solver.SPARSE
+            options.reduce = reduce
+            # The first reduced solve builds the reduction, which later ones reuse
+            start = time.perf_counter()
+            graph.compute_pagerank(options)
+            first = time.perf_counter() - start
+            t, result = time_solve(graph, options, args.repeats)
+            name = "reduced" if reduce else "sparse"
+            print(f"    {name:7s}: {t * 1e3:9.2f} ms  {result.num_iterations:4d} iterations  (first {first * 1e3:.2f} ms)")
+
+
+def bench_fingerprint(args):
+    """Fingerprint index: build, save and map, then single-seed PPR queries against full solves."""
+    print("\n" + "=" * 60)
+    print("Personalized PageRank fingerprints")
+    print("=" * 60)
+
+    num_nodes = args.large_nodes // 100
+    graph = build_random_graph(num_nodes, args.edges_per_node, args.seed)
+    path = Path(__file__).parent / "outputs" / "fingerprints.idx"
+    path.parent.mkdir(exist_ok=True)
+
+    for walks in [64, 256, 1024]:
+        options = pagerank_cpp.FingerprintOptions()
+        options.walks_per_node = walks
+        start = time.perf_counter()
+        index = graph.build_fingerprint_index(options)
+        t_build = time.perf_counter() - start
+        index.save(str(path))
+        start = time.perf_counter()
+        index = pagerank_cpp.FingerprintIndex.load(str(path))
+        t_load = time.perf_counter() - start
+
+        rng = random.Random(args.seed)
+        seeds = [str(rng.randrange(num_nodes)) for _ in range(100)]
+        start = time.perf_counter()
+        for seed in seeds:
+            index.top_k(seed, 10)
+        t_query = (time.perf_counter() - start) / len(seeds)
+
+        # Overlap of the estimated top 10 with the exact one, on a few seeds
+        overlap = 0
+        for seed in seeds[:5]:
+            exact = pagerank_cpp.Options()
+            exact.dangling = pagerank_cpp.DanglingPolicy.TELEPORT
+            exact.personalization = {seed: 1.0}
+            scores = graph.compute_pagerank(exact).pagerank_scores
+            best = sorted(range(num_nodes), key=lambda v: -scores[v])[:10]
+            overlap += len({str(v) for v in best} & {label for label, _ in index.top_k(seed, 10)})
+
+        print(f"  {walks:5d} walks: build {t_build * 1e3:9.2f} ms  load {t_load * 1e3:7.2f} ms  "
+              f"{index.size_bytes() / 2**20:7.1f} MB  query {t_query * 1e6:7.1f} us  top-10 overlap {overlap / 50:.0%}")
+
+
+def bench_cheirank(args):
+    """PageRank and CheiRank from two separate solves against one fused pass."""
+    print("\n" + "=" * 60)
+    print("Fused PageRank and CheiRank")
+    print("=" * 60)
+
+    num_nodes = args.large_nodes // 10
+    graph = build_random_graph(num_nodes, args.edges_per_node, args.seed)
+    # The transposed graph, for the separate CheiRank solve
+    src, dest = zip(*graph.get_edges())
+    transposed = pagerank_cpp.Graph()
+    transposed.add_nodes(graph.get_nodes())
+    transposed.add_edges_by_label(list(dest), list(src))
+
+    options = pagerank_cpp.Options()
+    options.solver = pagerank_cpp.Solver.SPARSE
+    t_pagerank, r_pagerank = time_solve(graph, options, args.repeats)
+    t_cheirank, r_cheirank = time_solve(transposed, options, args.repeats)
+    options.cheirank = True
+    t_fused, r_fused = time_solve(graph, options, args.repeats)
+
+    print(f"  separate: {(t_pagerank + t_cheirank) * 1e3:9.2f} ms  "
+          f"{r_pagerank.num_iterations} + {r_cheirank.num_iterations} iterations")
+    print(f"  fused:    {t_fused * 1e3:9.2f} ms  {r_fused.num_iterations} iterations  "
+          f"({(t_pagerank + t_cheirank) / t_fused:.2f}x)")
+
+
+def bench_top_k(args):
+    """Full convergence against stopping once the top k ranking settles."""
+    print("\n" + "=" * 60)
+    print("Top-k termination")
+    print("=" * 60)
+
+    graph = build_random_graph(args.large_nodes // 10, args.edges_per_node, args.seed)
+    options = pagerank_cpp.Options()
+    options.solver = pagerank_cpp.Solver.SPARSE
+    t_full, r_full = time_solve(graph, options, args.repeats)
+    full_order = sorted(range(len(r_full.pagerank_scores)), key=lambda v: -r_full.pagerank_scores[v])
+    print(f"  full:     {t_full * 1e3:9.2f} ms  {r_full.num_iterations} iterations")
+
+    for k in (10, 100):
+        options.top_k = k
+        t_top, r_top = time_solve(graph, options, args.repeats)
+        top_order = sorted(range(len(r_top.pagerank_scores)), key=lambda v: -r_top.pagerank_scores[v])
+        agree = sum(a == b for a, b in zip(full_order[:k], top_order[:k]))
+        print(f"  top {k:<4}: {t_top * 1e3:9.2f} ms  {r_top.num_iterations} iterations  "
+              f"({r_top.termination.name}, {agree}/{k} ranks as in the full solve)")
+
+
+def bench_bitset(args):
+    """Gather over the in-links against lookups over the adjacency bits on dense graphs."""
+    print("\n" + "=" * 60)
+    print("Bitset solver on dense graphs")
+    print("=" * 60)
+
+    num_nodes = 2000
+    for density in (0.1, 0.2, 0.5):
+        graph = build_random_graph(num_nodes, int(num_nodes * density), args.seed)
+        options = pagerank_cpp.Options()
+        options.solver = pagerank_cpp.Solver.SPARSE
+        t_sparse, _ = time_solve(graph, options, args.repeats)
+        options.solver = pagerank_cpp.Solver.BITSET
+        t_bitset, _ = time_solve(graph, options, args.repeats)
+        auto = graph.compute_pagerank(pagerank_cpp.Options()).solver
+        print(f"  density {density:.1f}: sparse {t_sparse * 1e3:8.2f} ms  bitset {t_bitset * 1e3:8.2f} ms  "
+              f"({t_sparse / t_bitset:.2f}x, auto picks {auto.name})")
+
+
+def bench_dense(args):
+    """Dense Google matrix mat-vec against the sparse gather, by thread count."""
+    print("\n" + "=" * 60)
+    print("Dense solver")
+    print("=" * 60)
+
+    for num_nodes in (500, 2000):
+        graph = build_random_graph(num_nodes, num_nodes // 10, args.seed)
+        options = pagerank_cpp.Options()
+        options.solver = pagerank_cpp.Solver.SPARSE
+        t_sparse, _ = time_solve(graph, options, args.repeats)
+        options.solver = pagerank_cpp.Solver.DENSE
+        for threads in (1, 0):
+            options.num_threads = threads
+            t_dense, result = time_solve(graph, options, args.repeats)
+            print(f"  {num_nodes:5d} nodes, {result.num_threads} threads: dense {t_dense * 1e3:8.2f} ms  "
+                  f"sparse {t_sparse * 1e3:8.2f} ms  ({pagerank_cpp.Graph.dense_memory(num_nodes) / 2**20:.1f} MB matrix)")
+
+
+def bench_batch(args):
+    """Thousands of session-sized graphs: one call per graph against one batch call."""
+    print("\n" + "=" * 60)
+    print("Batch solve of small graphs")
+    print("=" * 60)
+
+    graphs = [build_random_graph(8 + i % 24, 3, args.seed + i) for i in range(5000)]
+    for graph in graphs:
+        graph.finalize()
+    options = pagerank_cpp.Options()
+
+    best_loop = best_batch = float('inf')
+    for _ in range(args.repeats):
+        start = time.perf_counter()
+        for graph in graphs:
+            graph.compute_pagerank(options)
+        best_loop = min(best_loop, time.perf_counter() - start)
+
+        start = time.perf_counter()
+        results = pagerank_cpp.solve_batch(graphs, options)
+        best_batch = min(best_batch, time.perf_counter() - start)
+
+    print(f"  {len(graphs)} graphs: one call each {best_loop * 1e3:8.2f} ms  "
+          f"batch {best_batch * 1e3:8.2f} ms on {results[0].num_threads} threads  ({best_loop / best_batch:.2f}x)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="PageRank solver benchmarks")
+    parser.add_argument('-n', '--nodes', type=int, default=2000)
+    parser.add_argument('-e', '--edges-per-node', type=int, default=8)
+    parser.add_argument('-r', '--repeats', type=int, default=3)
+    parser.add_argument('-s', '--seed', type=int, default=42)
+    parser.add_argument('-l', '--large-nodes', type=int, default=3_000_000)
+    args = parser.parse_args()
+
+    print(f"Building random graph: {args.nodes} nodes, {args.edges_per_node} edges per node")
+    graph = build_random_graph(args.nodes, args.edges_per_node, args.seed)
+
+    bench_buffers(graph, args.repeats)
+    bench_huge_pages(args)
+    bench_prefetch(args)
+    bench_auto(args)
+    bench_build(args)
+    bench_lumped(args)
+    bench_aggregation(args)
+    bench_acceleration(args)
+    bench_reduction(args)
+    bench_fingerprint(args)
+    bench_cheirank(args)
+    bench_top_k(args)
+    bench_bitset(args)
+    bench_dense(args)
+    bench_batch(args)
+
+
+if __name__ == "__main__":
+    main()
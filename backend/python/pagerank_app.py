@@ -53,6 +53,23 @@ def compute_pagerank(graph):
     return graph.compute_pagerank()
 
 
+def print_statistics(graph):
+    stats = graph.statistics()
+
+    print("\n" + "=" * 50)
+    print("Graph Statistics")
+    print("=" * 50)
+    print(f"  Nodes:              {stats.num_nodes}")
+    print(f"  Edges:              {stats.num_edges}")
+    print(f"  Density:            {stats.density:.6f}")
+    print(f"  Dangling nodes:     {stats.num_dangling} ({stats.dangling_fraction:.1%})")
+    print(f"  Source nodes:       {stats.num_sources}")
+    print(f"  Self loops:         {stats.num_self_loops}")
+    print(f"  Max in/out degree:  {stats.max_in_degree} / {stats.max_out_degree}")
+    print(f"  Reciprocity:        {stats.reciprocity:.4f}")
+    print(f"  SCCs:               {stats.num_sccs} (largest {stats.largest_scc} nodes)")
+
+
 def print_results(graph, result):
     nodes = graph.get_nodes()
     scores = result.pagerank_scores
@@ -64,6 +81,8 @@ def print_results(graph, result):
         print(f"  {node}: {score:.6f}")
     print("=" * 50)
     print(f"Converged in {result.num_iterations} iterations")
+    sweep = "Gauss-Seidel" if result.in_place else "Jacobi"
+    print(f"Solver: {result.solver.name.lower()} ({sweep}, {result.num_threads} threads)")
     print("=" * 50 + "\n")
 
 
@@ -197,6 +216,7 @@ def main():
     parser.add_argument('-c', '--config', default='graph_config.json')
     parser.add_argument('-v', '--visualize', action='store_true')
     parser.add_argument('--no-print', action='store_true')
+    parser.add_argument('--stats', action='store_true', help='print graph statistics')
     args = parser.parse_args()
 
     config_path = Path(__file__).parent / args.config
@@ -208,6 +228,9 @@ def main():
     print(f"Nodes: {graph.num_nodes()}")
     print(f"Edges: {len(graph.get_edges())}")
 
+    if args.stats:
+        print_statistics(graph)
+
     result = compute_pagerank(graph)
 
     if not args.no_print:
@@ -0,0 +1,297 @@
+#include "graph.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "sparse_problem.h"
+#include "summation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/* Coarse blocks never exceed this many, so the dense coarse solve stays small */
+static constexpr size_t AGGREGATION_MAX_BLOCKS = 256;
+
+/* The coarse matrix gets about one entry per this many edges */
+static constexpr size_t EDGES_PER_COARSE_ENTRY = 16;
+
+/* Power iterations of the coarse solve; it converges at the same rate as the fine one */
+static constexpr size_t COARSE_MAX_ITER = 200;
+
+/*
+ * Contiguous blocks of 2^shift nodes in index order. Nodes added together
+ * (pages of one host, members of one community) usually land in the same
+ * block, and finding the block of a node is a shift.
+ */
+struct Aggregation {
+    size_t num_blocks;
+    size_t shift;
+
+    size_t block_of(size_t node) const { return node >> shift; }
+    size_t first(size_t block) const { return block << shift; }
+    size_t size(size_t block, size_t num_nodes) const { return std::min(num_nodes, first(block + 1)) - first(block); }
+};
+
+/* An explicit block count is clamped like the derived one, the coarse solve is dense in it */
+static Aggregation make_aggregation(size_t num_nodes, size_t num_edges, size_t wanted)
+{
+    if(wanted == 0)
+        wanted = static_cast<size_t>(std::sqrt(static_cast<double>(num_edges / EDGES_PER_COARSE_ENTRY)));
+    wanted = std::min(wanted, AGGREGATION_MAX_BLOCKS);
+    wanted = std::max<size_t>(wanted, 2);
+
+    Aggregation aggregation;
+    aggregation.shift = 0;
+    while((num_nodes >> aggregation.shift) >= wanted && (size_t{1} << aggregation.shift) < num_nodes)
+        aggregation.shift++;
+    aggregation.num_blocks = ((num_nodes - 1) >> aggregation.shift) + 1;
+    return aggregation;
+}
+
+/* The thread row ranges moved onto block boundaries, so every block is owned by one thread */
+static std::vector<size_t> block_aligned_splits(const std::vector<size_t>& row_splits, const Aggregation& aggregation,
+                                                size_t num_nodes)
+{
+    std::vector<size_t> splits{0};
+    for(size_t t = 1; t + 1 < row_splits.size(); t++)
+    {
+        size_t half_block = (size_t{1} << aggregation.shift) / 2;
+        size_t aligned = aggregation.first(aggregation.block_of(row_splits[t] + half_block));
+        if(aligned > splits.back() && aligned < num_nodes)
+            splits.push_back(aligned);
+    }
+    splits.push_back(num_nodes);
+    return splits;
+}
+
+/*
+ * Builds the column-stochastic coarse Google matrix of the current scores r,
+ * the chance that a unit of score in block J moves to block I next step:
+ *
+ *     C[I][J] = alpha * flow(J -> I) / R_J
+ *             + alpha * dangling(J) / R_J * T_I
+ *             + (1 - alpha) * V_I
+ *
+ * where R_J is the score on J, flow sums r_u * w(u, v) / out(u) over the
+ * edges u -> v from J into I, T is where dangling score goes and V is the
+ * teleport vector, both summed over the block. The edge pass runs on the
+ * block-aligned row ranges, so each thread writes its own rows of C.
+ */
+template <typename Features>
+static void build_coarse_matrix(const SparseProblem& problem, const PageRankOptions& options,
+                                const Aggregation& aggregation, const std::vector<size_t>& splits,
+                                const typename Features::Scalar* r, double* scaled,
+                                std::vector<double>& block_scores, std::vector<double>& coarse)
+{
+    const size_t K = aggregation.num_blocks;
+    const size_t n = problem.num_nodes;
+    const CSR& in_links = *problem.in_links;
+    const double alpha = problem.alpha;
+
+    std::vector<double> block_dangling(K, 0.0);
+    block_scores.assign(K, 0.0);
+    coarse.assign(K * K, 0.0);
+
+    parallel_ranges(splits, [&](size_t, size_t begin, size_t end) {
+        for(size_t u = begin; u < end; u++)
+        {
+            double score = static_cast<double>(r[u]);
+            scaled[u] = score * problem.inv_out_degrees[u];
+            block_scores[aggregation.block_of(u)]   += score;
+            block_dangling[aggregation.block_of(u)] += score * problem.dangling_flags[u];
+        }
+    });
+
+    parallel_ranges(splits, [&](size_t, size_t begin, size_t end) {
+        for(size_t v = begin; v < end; v++)
+        {
+            double* row = coarse.data() + aggregation.block_of(v) * K;
+            for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+            {
+                size_t u = static_cast<size_t>(in_links.indices[e]);
+                if constexpr (Features::Weighted)
+                    row[aggregation.block_of(u)] += in_links.weights[e] * scaled[u];
+                else
+                    row[aggregation.block_of(u)] += scaled[u];
+            }
+        }
+    });
+
+    /* Teleport and uniform weight of every block */
+    std::vector<double> block_teleport(K, 0.0);
+    std::vector<double> block_uniform(K, 0.0);
+    for(size_t v = 0; v < n; v++)
+    {
+        block_teleport[aggregation.block_of(v)] += problem.teleport[v];
+        block_uniform[aggregation.block_of(v)]  += 1.0 / static_cast<double>(n);
+    }
+    const std::vector<double>& dangling_target = (options.dangling == DanglingPolicy::UNIFORM) ? block_uniform
+                                                                                                : block_teleport;
+
+    for(size_t J = 0; J < K; J++)
+    {
+        /* A block without score has no proportions to weigh its columns by; it teleports */
+        if(block_scores[J] <= 0.0)
+        {
+            for(size_t I = 0; I < K; I++)
+                coarse[I * K + J] = block_teleport[I];
+            continue;
+        }
+
+        double inv_score = 1.0 / block_scores[J];
+        double dangling  = alpha * block_dangling[J] * inv_score;
+        for(size_t I = 0; I < K; I++)
+        {
+            double value = alpha * coarse[I * K + J] * inv_score + (1.0 - alpha) * block_teleport[I];
+            if(options.dangling != DanglingPolicy::SELF_LOOP)
+                value += dangling * dangling_target[I];
+            else if(I == J)
+                value += dangling;
+            coarse[I * K + J] = value;
+        }
+    }
+}
+
+/* Stationary vector of the coarse matrix, by power iteration from the current block scores */
+static std::vector<double> solve_coarse(const std::vector<double>& coarse, std::vector<double> z, double epsilon)
+{
+    const size_t K = z.size();
+    std::vector<double> z_new(K);
+
+    double total = 0.0;
+    for(double value : z)
+        total += value;
+    for(double& value : z)
+        value /= total;
+
+    for(size_t i = 0; i < COARSE_MAX_ITER; i++)
+    {
+        double diff = 0.0;
+        for(size_t I = 0; I < K; I++)
+        {
+            const double* row = coarse.data() + I * K;
+            double sum = 0.0;
+            for(size_t J = 0; J < K; J++)
+                sum += row[J] * z[J];
+            z_new[I] = sum;
+            diff += std::abs(sum - z[I]);
+        }
+        z.swap(z_new);
+        if(diff < epsilon)
+            break;
+    }
+    return z;
+}
+
+/*
+ * Iterative aggregation/disaggregation (Koury-McAllister-Stewart). Every
+ * iteration:
+ *
+ *  1. aggregates the scores into the K x K coarse chain of the blocks;
+ *  2. solves the coarse chain for the block totals z;
+ *  3. disaggregates, rescaling every block so it holds z_J while keeping
+ *     the proportions inside it;
+ *  4. smooths with one power step, whose change is the measured residual.
+ *
+ * The coarse solve moves score between blocks in one go, which a power
+ * iteration only does at the rate its slowest mode between weakly linked
+ * blocks decays. Each iteration costs two passes over the edges, so the
+ * method wins where power iterations need more than twice as many steps.
+ */
+template <typename Features>
+static struct PageRankResult aggregation_iteration(const SparseProblem& problem, const PageRankOptions& options,
+                                                   const Aggregation& aggregation)
+{
+    using Scalar = typename Features::Scalar;
+
+    ConvergenceTracker tracker(options.check_every, problem.epsilon, problem.max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+    const size_t n = problem.num_nodes;
+    const size_t K = aggregation.num_blocks;
+    const std::vector<size_t> splits = block_aligned_splits(problem.row_splits, aggregation, n);
+
+    pr_vector<Scalar> r_old(n, static_cast<Scalar>(1.0 / static_cast<double>(n)));
+    pr_vector<Scalar> r_new;
+    if(!options.in_place)
+        r_new.resize(n, Scalar(0));
+
+    pr_vector<Scalar> scaled(n);
+    pr_vector<double> coarse_scaled(n);
+    GatherArgs<Scalar> args = gather_args(problem, options, scaled.data());
+
+    std::vector<double> block_scores;
+    std::vector<double> coarse;
+
+    for(size_t i = 0; i < problem.max_iter; i++)
+    {
+        build_coarse_matrix<Features>(problem, options, aggregation, splits, r_old.data(), coarse_scaled.data(),
+                                      block_scores, coarse);
+        std::vector<double> z = solve_coarse(coarse, block_scores, problem.epsilon / static_cast<double>(K));
+
+        parallel_ranges(splits, [&](size_t, size_t begin, size_t end) {
+            for(size_t v = begin; v < end; v++)
+            {
+                size_t J = aggregation.block_of(v);
+                if(block_scores[J] > 0.0)
+                    r_old[v] = static_cast<Scalar>(static_cast<double>(r_old[v]) * z[J] / block_scores[J]);
+                else
+                    r_old[v] = static_cast<Scalar>(z[J] / static_cast<double>(aggregation.size(J, n)));
+            }
+        });
+
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double d = power_step<Features, S>(problem, options, args, measure, r_old.data(),
+                                               options.in_place ? r_old.data() : r_new.data());
+            /* An in-place sweep does not preserve the sum, a Jacobi step does */
+            if(options.in_place)
+                renormalize<S>(r_old.data(), n);
+            else
+                r_old.swap(r_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old.data(), n);
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old.data(), n))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+struct PageRankResult Graph::solve_aggregation(const PageRankOptions& options)
+{
+    if(this->num_nodes == 0)
+        return PageRankResult{{}, {}, 0};
+
+    SparseProblem problem = prepare_sparse(options);
+    Aggregation aggregation = make_aggregation(this->num_nodes, this->in_links.num_entries(), options.num_blocks);
+
+    #ifdef DEBUG
+        std::cout << "Aggregation solver: " << this->num_nodes << " nodes in " << aggregation.num_blocks
+                  << " blocks of " << (size_t{1} << aggregation.shift) << ", "
+                  << problem.row_splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    PageRankResult result = dispatch_features(problem, options, [&](auto features) {
+        return aggregation_iteration<decltype(features)>(problem, options, aggregation);
+    });
+    result.num_threads = problem.row_splits.size() - 1;
+    return result;
+}
@@ -0,0 +1,270 @@
+#include "graph.h"
+#include "convergence.h"
+#include "csr.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "sparse_problem.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/*
+ * Rows plus edges each batch thread should get before another thread pays for
+ * its start. Threads start once per batch rather than once per step, so this
+ * is well below SPARSE_WORK_PER_THREAD.
+ */
+static constexpr size_t BATCH_WORK_PER_THREAD = size_t{1} << 12;
+
+/*
+ * Every graph of a batch side by side in one block-diagonal system: node v
+ * of block b is row node_offsets[b] + v, and the in-links, degrees, teleport
+ * vectors and dangling sets of all blocks share one set of arrays.
+ */
+struct BatchProblem {
+    CSR in_links;                       /* Block diagonal, sources as packed rows */
+    pr_vector<double> inv_out_degrees;
+    pr_vector<double> teleport;         /* Normalized per block */
+    pr_vector<double> dangling_flags;   /* 1 for dangling nodes, used with self-loops */
+    pr_vector<int> dangling_nodes;      /* Packed rows of the dangling nodes, block after block */
+    std::vector<size_t> node_offsets;   /* First row of each block, plus the total */
+    std::vector<size_t> dangling_offsets;
+    std::vector<size_t> block_splits;   /* Block range of each thread */
+};
+
+/*
+ * Power iteration of block b alone, to its own convergence, by the sparse
+ * gather kernel over the block's rows of the packed arrays. In place, the
+ * steps are Gauss-Seidel sweeps renormalized after each one.
+ */
+template <typename Features>
+static struct PageRankResult batch_block(const BatchProblem& batch, const PageRankOptions& options,
+                                         GatherArgs<double> args, size_t b, double alpha, double epsilon,
+                                         size_t max_iter, double* r_a, double* r_b)
+{
+    ConvergenceTracker tracker(options.check_every, epsilon, max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+    const size_t begin = batch.node_offsets[b], end = batch.node_offsets[b + 1];
+    const size_t n = end - begin;
+
+    double* r_old = r_a;
+    double* r_new = options.in_place ? r_a : r_b;
+    std::fill(r_old + begin, r_old + end, 1.0 / static_cast<double>(n));
+
+    for(size_t i = 0; i < max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double dangling_mass = 0.0;
+            if(options.dangling != DanglingPolicy::SELF_LOOP)
+            {
+                Accumulator<S> dangling;
+                for(size_t k = batch.dangling_offsets[b]; k < batch.dangling_offsets[b + 1]; k++)
+                    dangling.add(r_old[batch.dangling_nodes[k]]);
+                dangling_mass = dangling.value();
+            }
+            TeleportTerms terms = teleport_terms(options, alpha, dangling_mass, n);
+            args.teleport_scale = terms.scale;
+            args.base           = terms.base;
+
+            prescale(r_old + begin, batch.inv_out_degrees.data() + begin, args.scaled + begin, n);
+            args.r_old = r_old;
+            args.r_new = r_new;
+
+            double d;
+            if(options.in_place)
+            {
+                d = gather_step<Features, true, S>(args, begin, end, measure).value(options.norm);
+                renormalize<S>(r_old + begin, n);
+            }
+            else
+            {
+                d = gather_step<Features, false, S>(args, begin, end, measure).value(options.norm);
+                std::swap(r_old, r_new);
+            }
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old + begin, n);
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old + begin, n))
+            break;
+    }
+
+    PageRankResult result{std::vector<double>(r_old + begin, r_old + end), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+/*
+ * Solves every graph of the batch in one call. The sparse storage of each
+ * graph is built first, then all of them are packed into one block-diagonal
+ * system and the blocks are split over threads by rows plus edges. Each
+ * thread runs its blocks one after another, every block converging on its
+ * own, so a thread starts once per batch instead of once per graph and step.
+ *
+ * Steps are double precision on the packed in-links, Jacobi or in place as
+ * asked. Solver choice, precision, acceleration, reduction and CheiRank are
+ * per-graph plans and do not apply. Null and empty graphs get default, empty results.
+ */
+std::vector<PageRankResult> Graph::solve_batch(const std::vector<Graph*>& graphs, const PageRankOptions& options)
+{
+    WorkerScope workers;
+    const size_t num_graphs = graphs.size();
+    std::vector<PageRankResult> results(num_graphs, PageRankResult{{}, {}, 0});
+
+    /* A graph listed twice is built once */
+    std::vector<Graph*> distinct;
+    for(Graph* graph : graphs)
+        if(graph != nullptr)
+            distinct.push_back(graph);
+    std::sort(distinct.begin(), distinct.end(), std::less<Graph*>());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+    size_t total_work = 0;
+    for(Graph* graph : distinct)
+        total_work += graph->num_nodes + graph->edge_src.size();
+    const size_t threads = options.num_threads != 0 ? options.num_threads
+                                                    : threads_for(total_work, BATCH_WORK_PER_THREAD);
+    /* Graphs build side by side, each on one thread, unless a single chunk takes them all */
+    const bool side_by_side = std::min(threads, distinct.size()) > 1;
+    parallel_for(distinct.size(), threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t k = begin; k < end; k++)
+        {
+            if(side_by_side)
+                distinct[k]->build_sparse(1);
+            else
+                distinct[k]->build_sparse();
+        }
+    });
+
+    /* Block offsets, then every block copied into its slice in parallel */
+    BatchProblem batch;
+    batch.node_offsets.assign(num_graphs + 1, 0);
+    batch.dangling_offsets.assign(num_graphs + 1, 0);
+    std::vector<size_t> edge_offsets(num_graphs + 1, 0);
+    bool weighted = false;
+    for(size_t b = 0; b < num_graphs; b++)
+    {
+        const Graph* graph = graphs[b];
+        size_t nodes = graph ? graph->num_nodes : 0;
+        batch.node_offsets[b + 1]     = batch.node_offsets[b] + nodes;
+        edge_offsets[b + 1]           = edge_offsets[b] + (graph ? graph->in_links.num_entries() : 0);
+        batch.dangling_offsets[b + 1] = batch.dangling_offsets[b] + (graph ? graph->stats.dangling_nodes.size() : 0);
+        weighted = weighted || (graph && graph->in_links.is_weighted());
+    }
+    const size_t total_nodes = batch.node_offsets[num_graphs];
+    if(total_nodes == 0)
+        return results;
+
+    /* Contiguous block ranges with about the same rows plus edges each */
+    const size_t parts = std::max<size_t>(1, std::min(threads, num_graphs));
+    const size_t total = total_nodes + edge_offsets[num_graphs];
+    batch.block_splits.assign(1, 0);
+    for(size_t t = 1; t < parts; t++)
+    {
+        size_t target = total * t / parts;
+        size_t b = batch.block_splits.back();
+        while(b < num_graphs && batch.node_offsets[b] + edge_offsets[b] < target)
+            b++;
+        batch.block_splits.push_back(b);
+    }
+    batch.block_splits.push_back(num_graphs);
+
+    batch.in_links.offsets.resize(total_nodes + 1);
+    batch.in_links.indices.resize(edge_offsets[num_graphs]);
+    if(weighted)
+        batch.in_links.weights.resize(edge_offsets[num_graphs]);
+    batch.inv_out_degrees.resize(total_nodes);
+    batch.teleport.resize(total_nodes);
+    batch.dangling_flags.assign(total_nodes, 0.0);
+    batch.dangling_nodes.resize(batch.dangling_offsets[num_graphs]);
+    batch.in_links.offsets[total_nodes] = edge_offsets[num_graphs];
+
+    parallel_ranges(batch.block_splits, [&](size_t, size_t first, size_t last) {
+        for(size_t b = first; b < last; b++)
+        {
+            const Graph* graph = graphs[b];
+            if(graph == nullptr || graph->num_nodes == 0)
+                continue;
+
+            const size_t row = batch.node_offsets[b], edge = edge_offsets[b];
+            const int shift = static_cast<int>(row);
+            const CSR& links = graph->in_links;
+            for(size_t v = 0; v < graph->num_nodes; v++)
+                batch.in_links.offsets[row + v] = edge + links.offsets[v];
+            for(size_t e = 0; e < links.num_entries(); e++)
+                batch.in_links.indices[edge + e] = links.indices[e] + shift;
+            if(weighted)
+            {
+                for(size_t e = 0; e < links.num_entries(); e++)
+                    batch.in_links.weights[edge + e] = links.is_weighted() ? links.weights[e] : 1.0;
+            }
+
+            std::copy(graph->inv_out_degrees.begin(), graph->inv_out_degrees.end(), batch.inv_out_degrees.begin() + row);
+            graph->fill_teleport_vector(options, batch.teleport.data() + row);
+
+            size_t k = batch.dangling_offsets[b];
+            for(int u : graph->stats.dangling_nodes)
+            {
+                batch.dangling_nodes[k++] = u + shift;
+                batch.dangling_flags[row + u] = 1.0;
+            }
+        }
+    });
+
+    #ifdef DEBUG
+        std::cout << "Batch solver: " << num_graphs << " graphs, " << total_nodes << " nodes, "
+                  << batch.in_links.num_entries() << " edges, " << batch.block_splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    /* Both score buffers and the pre-scaled scores, one allocation each for the whole batch */
+    pr_vector<double> r_a(total_nodes), r_b(options.in_place ? 0 : total_nodes), scaled(total_nodes);
+
+    GatherArgs<double> args;
+    args.in_links        = &batch.in_links;
+    args.scaled          = scaled.data();
+    args.inv_out_degrees = batch.inv_out_degrees.data();
+    args.teleport        = options.personalization.empty() ? nullptr : batch.teleport.data();
+    args.dangling        = (options.dangling == DanglingPolicy::SELF_LOOP) ? batch.dangling_flags.data() : nullptr;
+    args.distance        = std::max<size_t>(options.prefetch_distance, 1);
+    args.prefetch        = false;
+
+    branch(weighted, [&](auto w) {
+        using Features = KernelFeatures<double, decltype(w)::value>;
+        parallel_ranges(batch.block_splits, [&](size_t, size_t first, size_t last) {
+            for(size_t b = first; b < last; b++)
+            {
+                const Graph* graph = graphs[b];
+                if(graph == nullptr || graph->num_nodes == 0)
+                    continue;
+
+                GatherArgs<double> block_args = args;
+                block_args.alpha = graph->ALPHA;
+                results[b] = batch_block<Features>(batch, options, block_args, b, graph->ALPHA,
+                                                   graph->EPSILON, graph->MAX_ITER, r_a.data(),
+                                                   options.in_place ? r_a.data() : r_b.data());
+            }
+        });
+    });
+
+    for(size_t b = 0; b < num_graphs; b++)
+    {
+        if(graphs[b] == nullptr || graphs[b]->num_nodes == 0)
+            continue;
+        results[b].solver      = Solver::SPARSE;
+        results[b].in_place    = options.in_place;
+        results[b].num_threads = batch.block_splits.size() - 1;
+    }
+    return results;
+}
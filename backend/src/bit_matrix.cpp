@@ -0,0 +1,24 @@
+#include "bit_matrix.h"
+#include "parallel.h"
+
+BitMatrix build_bit_matrix(const CSR& csr, size_t num_cols, size_t num_threads)
+{
+    BitMatrix bits;
+    bits.num_rows      = csr.num_rows();
+    bits.num_cols      = num_cols;
+    bits.words_per_row = BitMatrix::bytes_for(1, num_cols) / sizeof(uint64_t);
+    bits.words.assign(bits.num_rows * bits.words_per_row, 0);
+
+    parallel_ranges(even_splits(bits.num_rows, num_threads), [&](size_t, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            uint64_t* row = bits.words.data() + i * bits.words_per_row;
+            for(size_t e = csr.offsets[i]; e < csr.offsets[i + 1]; e++)
+            {
+                size_t j = static_cast<size_t>(csr.indices[e]);
+                row[j >> 6] |= uint64_t{1} << (j & 63);
+            }
+        }
+    });
+    return bits;
+}
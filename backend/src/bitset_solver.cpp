@@ -0,0 +1,201 @@
+#include "graph.h"
+#include "bit_matrix.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "sparse_problem.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/* Row bytes each pass of the gather covers: 2048 sources, whose tables take 512 KB */
+constexpr size_t BITSET_CHUNK_BYTES = 256;
+
+/*
+ * Lookup tables of the pre-scaled scores: table g holds, for every byte value
+ * b, the sum of the scores of sources 8g + i over the set bits i of b. Built
+ * in 255 additions per table, each entry one subset plus one more source.
+ */
+static void build_tables(const double* scaled, size_t begin, size_t end, double* tables)
+{
+    for(size_t g = begin; g < end; g++)
+    {
+        double* table = tables + g * 256;
+        const double* sources = scaled + g * 8;
+        table[0] = 0.0;
+        for(size_t bit = 0; bit < 8; bit++)
+        {
+            size_t half = size_t{1} << bit;
+            for(size_t low = 0; low < half; low++)
+                table[half + low] = table[low] + sources[bit];
+        }
+    }
+}
+
+/*
+ * One power step over the adjacency bits (Four Russians). Row v of the matrix
+ * marks the sources of v's in-links, and each of its bytes indexes the table of
+ * its eight sources, so one lookup adds up to eight in-links. A step costs n^2 / 8
+ * lookups whatever the density, against one indexed load per edge for the
+ * gather over the in-links.
+ *
+ * The rows are split over threads. Each thread sweeps its rows once per chunk
+ * of sources, so the tables being read stay in cache. The lookups add up
+ * plainly. The summation mode applies to the dangling mass and the residual.
+ */
+template <Summation S>
+static double bitset_step(const SparseProblem& problem, const PageRankOptions& options, const BitMatrix& bits,
+                          const std::vector<size_t>& table_splits, bool measure, const double* r_old, double* r_new,
+                          double* scaled, double* tables)
+{
+    const size_t n = problem.num_nodes;
+    const double alpha = problem.alpha;
+    const size_t row_bytes = bits.words_per_row * sizeof(uint64_t);
+
+    double dangling_mass = 0.0;
+    const bool personalized = !options.personalization.empty();
+    const bool self_loop    = (options.dangling == DanglingPolicy::SELF_LOOP);
+    if(!self_loop)
+    {
+        Accumulator<S> dangling;
+        for(int u : *problem.dangling_nodes)
+            dangling.add(r_old[u]);
+        dangling_mass = dangling.value();
+    }
+    const TeleportTerms terms = teleport_terms(options, alpha, dangling_mass, n);
+
+    /* Sources past n are padding and keep a zero score */
+    parallel_ranges(table_splits, [&](size_t, size_t begin, size_t end) {
+        size_t first = std::min(begin * 8, n), last = std::min(end * 8, n);
+        prescale(r_old + first, problem.inv_out_degrees + first, scaled + first, last - first);
+        build_tables(scaled, begin, end, tables);
+    });
+
+    const std::vector<size_t>& splits = problem.row_splits;
+    std::vector<Residual<S>> partial(splits.size() - 1);
+    parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+        std::fill(r_new + begin, r_new + end, 0.0);
+        for(size_t chunk = 0; chunk < row_bytes; chunk += BITSET_CHUNK_BYTES)
+        {
+            const size_t chunk_end = std::min(chunk + BITSET_CHUNK_BYTES, row_bytes);
+            for(size_t v = begin; v < end; v++)
+            {
+                const unsigned char* row = reinterpret_cast<const unsigned char*>(bits.row(v));
+                double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+                for(size_t g = chunk; g < chunk_end; g += 4)
+                {
+                    sum0 += tables[g * 256 + row[g]];
+                    sum1 += tables[(g + 1) * 256 + row[g + 1]];
+                    sum2 += tables[(g + 2) * 256 + row[g + 2]];
+                    sum3 += tables[(g + 3) * 256 + row[g + 3]];
+                }
+                r_new[v] += (sum0 + sum1) + (sum2 + sum3);
+            }
+        }
+
+        for(size_t v = begin; v < end; v++)
+        {
+            double updated = alpha * r_new[v] + terms.base;
+            if(personalized)
+                updated += terms.scale * problem.teleport[v];
+            if(self_loop)
+                updated += alpha * r_old[v] * problem.dangling_flags[v];
+            r_new[v] = updated;
+
+            if(measure)
+                partial[t].add(r_old[v], updated);
+        }
+    });
+
+    Residual<S> residual;
+    for(const Residual<S>& part : partial)
+        residual.merge(part);
+    return residual.value(options.norm);
+}
+
+static struct PageRankResult bitset_iteration(const SparseProblem& problem, const PageRankOptions& options,
+                                              const BitMatrix& bits)
+{
+    ConvergenceTracker tracker(options.check_every, problem.epsilon, problem.max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+    const size_t n = problem.num_nodes;
+    const size_t groups = bits.words_per_row * sizeof(uint64_t);
+    const std::vector<size_t> table_splits = even_splits(groups, problem.row_splits.size() - 1);
+
+    pr_vector<double> r_old(n, 1.0 / static_cast<double>(n)), r_new(n, 0.0);
+    pr_vector<double> scaled(groups * 8, 0.0);
+    pr_vector<double> tables(groups * 256);
+
+    for(size_t i = 0; i < problem.max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double d = bitset_step<S>(problem, options, bits, table_splits, measure, r_old.data(),
+                                      r_new.data(), scaled.data(), tables.data());
+            r_old.swap(r_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old.data(), n);
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old.data(), n))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+const BitMatrix& Graph::get_adjacency_bits()
+{
+    build_sparse();
+    if(this->adj_bits.empty() && this->num_nodes != 0)
+        this->adj_bits = build_bit_matrix(this->in_links, this->num_nodes,
+                                          threads_for(this->in_links.num_entries(), SPARSE_WORK_PER_THREAD));
+    return this->adj_bits;
+}
+
+/* Jacobi steps in double precision over the adjacency bits of an unweighted graph */
+struct PageRankResult Graph::solve_bitset(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    if(n == 0)
+        return PageRankResult{{}, {}, 0};
+
+    PageRankOptions jacobi = options;
+    jacobi.in_place  = false;
+    jacobi.precision = Precision::DOUBLE;
+    SparseProblem problem = prepare_sparse(jacobi);
+    const BitMatrix& bits = get_adjacency_bits();
+
+    /* Every row costs the same number of lookups */
+    const size_t lookups = n * bits.words_per_row * sizeof(uint64_t);
+    size_t threads = options.num_threads != 0 ? options.num_threads : threads_for(lookups, BITSET_LOOKUPS_PER_THREAD);
+    problem.row_splits = even_splits(n, threads);
+
+    #ifdef DEBUG
+        std::cout << "Bitset solver: " << n << " nodes, " << this->in_links.num_entries() << " edges, "
+                  << bits.words.size() * sizeof(uint64_t) << " bytes of bits, "
+                  << problem.row_splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    PageRankResult result = bitset_iteration(problem, jacobi, bits);
+    result.num_threads = problem.row_splits.size() - 1;
+    return result;
+}
@@ -0,0 +1,263 @@
+#include "graph.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "sparse_problem.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/*
+ * Edges each thread of the fused pass should cover per entry of its scatter
+ * buffer, which it zeroes and the merge pass reads back every step.
+ */
+static constexpr size_t CHEIRANK_EDGES_PER_SCATTER_ENTRY = 4;
+
+/*
+ * The transposed graph, as seen from the in-links: node v links to every
+ * source u of its row, with the same weight. Its out-degrees are the
+ * in-degrees of the graph, and its dangling nodes are the graph's sources.
+ */
+struct TransposedSide {
+    pr_vector<double> inv_out_degrees;      /* 1 / (weighted) in-degree, 0 for sources */
+    pr_vector<double> dangling_flags;       /* 1 for sources */
+    std::vector<int> dangling_nodes;
+    std::vector<pr_vector<double>> scatter; /* Per-thread sums of the scattered scores */
+    std::vector<size_t> node_splits;        /* Node ranges of the pass merging them */
+};
+
+/*
+ * One fused step of PageRank r and CheiRank c, the PageRank of the transposed
+ * graph. Row v of the in-links lists every edge u -> v, which is v -> u in the
+ * transposed graph, so a single pass over the rows both gathers r into v and
+ * scatters c out of v:
+ *
+ *     r_new[v] += w(u, v) * r[u] / out(u)        c_new[u] += w(u, v) * c[v] / in(v)
+ *
+ * and the offsets, indices and weights are read once for both vectors. Rows
+ * are split over threads as usual; the scattered sums land anywhere, so each
+ * thread adds into its own buffer, and a second pass over node ranges merges
+ * the buffers in thread order and finishes c. The residual is the larger of
+ * the two.
+ */
+template <typename Features, Summation S>
+static double fused_step(const SparseProblem& problem, const PageRankOptions& options, TransposedSide& side, bool measure,
+                         const typename Features::Scalar* r_old, typename Features::Scalar* r_new,
+                         const typename Features::Scalar* c_old, typename Features::Scalar* c_new,
+                         typename Features::Scalar* r_scaled, typename Features::Scalar* c_scaled)
+{
+    using Scalar = typename Features::Scalar;
+
+    const size_t n = problem.num_nodes;
+    const double alpha = problem.alpha;
+    const CSR& in_links = *problem.in_links;
+
+    double r_dangling = 0.0, c_dangling = 0.0;
+    const bool personalized = !options.personalization.empty();
+    const bool self_loop    = (options.dangling == DanglingPolicy::SELF_LOOP);
+    if(!self_loop)
+    {
+        Accumulator<S> r_mass, c_mass;
+        for(int u : *problem.dangling_nodes)
+            r_mass.add(static_cast<double>(r_old[u]));
+        for(int v : side.dangling_nodes)
+            c_mass.add(static_cast<double>(c_old[v]));
+        r_dangling = r_mass.value();
+        c_dangling = c_mass.value();
+    }
+    const TeleportTerms r_terms = teleport_terms(options, alpha, r_dangling, n);
+    const TeleportTerms c_terms = teleport_terms(options, alpha, c_dangling, n);
+
+    const std::vector<size_t>& splits = problem.row_splits;
+    std::vector<Residual<S>> r_partial(splits.size() - 1);
+    parallel_ranges(splits, [&](size_t, size_t begin, size_t end) {
+        prescale(r_old + begin, problem.inv_out_degrees + begin, r_scaled + begin, end - begin);
+        prescale(c_old + begin, side.inv_out_degrees.data() + begin, c_scaled + begin, end - begin);
+    });
+
+    parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+        double* scatter = side.scatter[t].data();
+        std::fill(scatter, scatter + n, 0.0);
+
+        for(size_t v = begin; v < end; v++)
+        {
+            Accumulator<S> sum;
+            const double out_score = static_cast<double>(c_scaled[v]);
+            for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+            {
+                int u = in_links.indices[e];
+                if constexpr (Features::Weighted)
+                {
+                    sum.add(in_links.weights[e] * static_cast<double>(r_scaled[u]));
+                    scatter[u] += in_links.weights[e] * out_score;
+                }
+                else
+                {
+                    sum.add(static_cast<double>(r_scaled[u]));
+                    scatter[u] += out_score;
+                }
+            }
+
+            double old     = static_cast<double>(r_old[v]);
+            double updated = alpha * sum.value() + r_terms.base;
+            if(personalized)
+                updated += r_terms.scale * problem.teleport[v];
+            if(self_loop)
+                updated += alpha * old * problem.dangling_flags[v];
+            r_new[v] = static_cast<Scalar>(updated);
+
+            if(measure)
+                r_partial[t].add(old, updated);
+        }
+    });
+
+    std::vector<Residual<S>> c_partial(side.node_splits.size() - 1);
+    parallel_ranges(side.node_splits, [&](size_t t, size_t begin, size_t end) {
+        for(size_t u = begin; u < end; u++)
+        {
+            double sum = 0.0;
+            for(const pr_vector<double>& scatter : side.scatter)
+                sum += scatter[u];
+
+            double old     = static_cast<double>(c_old[u]);
+            double updated = alpha * sum + c_terms.base;
+            if(personalized)
+                updated += c_terms.scale * problem.teleport[u];
+            if(self_loop)
+                updated += alpha * old * side.dangling_flags[u];
+            c_new[u] = static_cast<Scalar>(updated);
+
+            if(measure)
+                c_partial[t].add(old, updated);
+        }
+    });
+
+    Residual<S> r_residual, c_residual;
+    for(const Residual<S>& part : r_partial)
+        r_residual.merge(part);
+    for(const Residual<S>& part : c_partial)
+        c_residual.merge(part);
+    return std::max(r_residual.value(options.norm), c_residual.value(options.norm));
+}
+
+template <typename Features>
+static struct PageRankResult fused_iteration(const SparseProblem& problem, const PageRankOptions& options,
+                                             TransposedSide& side)
+{
+    using Scalar = typename Features::Scalar;
+
+    ConvergenceTracker tracker(options.check_every, problem.epsilon, problem.max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+    const size_t n = problem.num_nodes;
+
+    const Scalar start = static_cast<Scalar>(1.0 / static_cast<double>(n));
+    pr_vector<Scalar> r_old(n, start), r_new(n, Scalar(0));
+    pr_vector<Scalar> c_old(n, start), c_new(n, Scalar(0));
+    pr_vector<Scalar> r_scaled(n), c_scaled(n);
+
+    for(size_t i = 0; i < problem.max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double d = fused_step<Features, S>(problem, options, side, measure, r_old.data(), r_new.data(),
+                                               c_old.data(), c_new.data(), r_scaled.data(), c_scaled.data());
+            r_old.swap(r_new);
+            c_old.swap(c_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+            {
+                renormalize<S>(r_old.data(), n);
+                renormalize<S>(c_old.data(), n);
+            }
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old.data(), n))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.cheirank_vector.assign(c_old.begin(), c_old.end());
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+/*
+ * PageRank and CheiRank together, under the same options: the teleport
+ * vector and dangling policy apply to both graphs. Jacobi steps only, since a
+ * sweep would read scattered sums that are not complete yet.
+ */
+struct PageRankResult Graph::solve_cheirank(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    if(n == 0)
+        return PageRankResult{{}, {}, 0};
+
+    PageRankOptions jacobi = options;
+    jacobi.in_place = false;
+    SparseProblem problem = prepare_sparse(jacobi);
+
+    /* Weighted in-degrees are the row sums of the in-links */
+    TransposedSide side;
+    side.inv_out_degrees.assign(n, 0.0);
+    side.dangling_flags.assign(n, 0.0);
+    for(size_t v = 0; v < n; v++)
+    {
+        double total = 0.0;
+        for(size_t e = this->in_links.offsets[v]; e < this->in_links.offsets[v + 1]; e++)
+            total += this->in_links.is_weighted() ? this->in_links.weights[e] : 1.0;
+
+        if(this->in_links.degree(v) == 0)
+        {
+            side.dangling_nodes.push_back(static_cast<int>(v));
+            side.dangling_flags[v] = 1.0;
+        }
+        else
+            side.inv_out_degrees[v] = 1.0 / total;
+    }
+
+    /*
+     * Each thread zeroes a scatter buffer of n doubles and the merge reads it
+     * back every step, so by graph size a thread needs several edges per
+     * buffer entry. The buffers also have to fit the memory budget.
+     */
+    size_t threads = problem.row_splits.size() - 1;
+    if(options.num_threads == 0)
+        threads = std::min(threads, threads_for(this->in_links.num_entries(), CHEIRANK_EDGES_PER_SCATTER_ENTRY * n));
+    if(this->memory_budget != 0)
+    {
+        const size_t buffer_bytes = allocation_size(n * sizeof(double));
+        const size_t used = memory_usage().total();
+        const size_t fit = (this->memory_budget > used) ? (this->memory_budget - used) / buffer_bytes : 0;
+        threads = std::max<size_t>(1, std::min(threads, fit));
+    }
+    if(threads != problem.row_splits.size() - 1)
+        problem.row_splits = balanced_row_splits(this->in_links, threads);
+
+    side.scatter.assign(threads, pr_vector<double>(n));
+    side.node_splits = even_splits(n, threads);
+
+    #ifdef DEBUG
+        std::cout << "Fused PageRank/CheiRank: " << n << " nodes, " << side.dangling_nodes.size()
+                  << " sources, " << threads << " threads" << std::endl;
+    #endif
+
+    PageRankResult result = dispatch_features(problem, jacobi, [&](auto features) {
+        return fused_iteration<decltype(features)>(problem, jacobi, side);
+    });
+    result.num_threads = threads;
+    return result;
+}
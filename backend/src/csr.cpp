@@ -0,0 +1,247 @@
+#include "csr.h"
+#include "parallel.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/*
+ * Per-thread histograms cost one counter per row each. Past about two threads
+ * per average row entry they would outweigh the entries they sort.
+ */
+static size_t histogram_threads(size_t num_rows, size_t num_entries, size_t num_threads)
+{
+    size_t affordable = std::max<size_t>(1, 2 * num_entries / std::max<size_t>(num_rows, 1));
+    return std::max<size_t>(1, std::min(num_threads, affordable));
+}
+
+/*
+ * Turns the per-thread counts of every row into write cursors, in place:
+ *
+ *     counts[t][row] = offsets[row] + sum_{t' < t} counts[t'][row]
+ *
+ * so the entries of a row land in thread order, which is input order. Fills
+ * offsets along the way. The rows are split across the same threads: every
+ * range is totalled, the totals are scanned, then every range is written.
+ */
+static void counts_to_cursors(std::vector<std::vector<size_t>>& counts, pr_vector<size_t>& offsets,
+                              size_t num_rows)
+{
+    std::vector<size_t> row_splits = even_splits(num_rows, counts.size());
+    std::vector<size_t> range_totals(row_splits.size(), 0);
+
+    parallel_ranges(row_splits, [&](size_t t, size_t begin, size_t end) {
+        size_t total = 0;
+        for(size_t row = begin; row < end; row++)
+            for(const std::vector<size_t>& local : counts)
+                total += local[row];
+        range_totals[t + 1] = total;
+    });
+    for(size_t t = 1; t < range_totals.size(); t++)
+        range_totals[t] += range_totals[t - 1];
+
+    parallel_ranges(row_splits, [&](size_t t, size_t begin, size_t end) {
+        size_t position = range_totals[t];
+        for(size_t row = begin; row < end; row++)
+        {
+            offsets[row] = position;
+            for(std::vector<size_t>& local : counts)
+            {
+                size_t count = local[row];
+                local[row] = position;
+                position += count;
+            }
+        }
+    });
+    offsets[num_rows] = range_totals.back();
+}
+
+/*
+ * Sorts one row by column and collapses repeated columns, keeping the entry
+ * added last. Entries arrive in input order and the sort is stable, so the
+ * last of a run of equal columns is the last one added. Returns the new length.
+ */
+static size_t sort_row(int* cols, double* weights, size_t length, std::vector<std::pair<int, double>>& scratch)
+{
+    /* Rows of graphs added in order are usually sorted and unique already */
+    if(std::adjacent_find(cols, cols + length, [](int a, int b) { return a >= b; }) == cols + length)
+        return length;
+
+    if(weights == nullptr)
+    {
+        std::sort(cols, cols + length);
+        return static_cast<size_t>(std::unique(cols, cols + length) - cols);
+    }
+
+    scratch.resize(length);
+    for(size_t k = 0; k < length; k++)
+        scratch[k] = {cols[k], weights[k]};
+    std::stable_sort(scratch.begin(), scratch.end(),
+                     [](const std::pair<int, double>& a, const std::pair<int, double>& b) { return a.first < b.first; });
+
+    size_t kept = 0;
+    for(size_t k = 0; k < length; k++)
+    {
+        bool repeated = (k + 1 < length) && scratch[k + 1].first == scratch[k].first;
+        if(repeated)
+            continue;
+        cols[kept]    = scratch[k].first;
+        weights[kept] = scratch[k].second;
+        kept++;
+    }
+    return kept;
+}
+
+CSR build_csr(size_t num_rows, const pr_vector<int>& rows, const pr_vector<int>& cols,
+              const pr_vector<double>* weights, size_t num_threads)
+{
+    const size_t num_entries = rows.size();
+    const bool weighted = (weights != nullptr);
+    num_threads = histogram_threads(num_rows, num_entries, num_threads);
+
+    CSR csr;
+    csr.offsets.assign(num_rows + 1, 0);
+    if(num_rows == 0)
+        return csr;
+
+    /* Pass 1: every thread counts the entries per row in its slice of the input */
+    std::vector<size_t> entry_splits = even_splits(num_entries, num_threads);
+    std::vector<std::vector<size_t>> counts(entry_splits.size() - 1);
+
+    parallel_ranges(entry_splits, [&](size_t t, size_t begin, size_t end) {
+        std::vector<size_t>& local = counts[t];
+        local.assign(num_rows, 0);
+        for(size_t k = begin; k < end; k++)
+            local[rows[k]]++;
+    });
+
+    counts_to_cursors(counts, csr.offsets, num_rows);
+
+    /* Pass 2: every thread scatters its slice through its own cursors */
+    pr_vector<int> scattered(num_entries);
+    pr_vector<double> scattered_weights(weighted ? num_entries : 0);
+
+    parallel_ranges(entry_splits, [&](size_t t, size_t begin, size_t end) {
+        std::vector<size_t>& cursor = counts[t];
+        for(size_t k = begin; k < end; k++)
+        {
+            size_t position = cursor[rows[k]]++;
+            scattered[position] = cols[k];
+            if(weighted)
+                scattered_weights[position] = (*weights)[k];
+        }
+    });
+    counts.clear();
+
+    /* Sort and deduplicate every row in place, split by rows plus entries */
+    std::vector<size_t> kept(num_rows);
+    std::vector<size_t> row_splits = balanced_row_splits(csr, num_threads);
+    std::vector<size_t> range_kept(row_splits.size(), 0);
+
+    parallel_ranges(row_splits, [&](size_t t, size_t begin, size_t end) {
+        std::vector<std::pair<int, double>> scratch;
+        size_t total = 0;
+        for(size_t row = begin; row < end; row++)
+        {
+            size_t first = csr.offsets[row];
+            kept[row] = sort_row(scattered.data() + first, weighted ? scattered_weights.data() + first : nullptr,
+                                 csr.offsets[row + 1] - first, scratch);
+            total += kept[row];
+        }
+        range_kept[t + 1] = total;
+    });
+    for(size_t t = 1; t < range_kept.size(); t++)
+        range_kept[t] += range_kept[t - 1];
+
+    /* Without repeated entries the scattered arrays are the final ones */
+    if(range_kept.back() == num_entries)
+    {
+        csr.indices = std::move(scattered);
+        csr.weights = std::move(scattered_weights);
+        return csr;
+    }
+
+    /* Otherwise close the gaps the collapsed entries left behind */
+    csr.indices.resize(range_kept.back());
+    if(weighted)
+        csr.weights.resize(range_kept.back());
+
+    pr_vector<size_t> compact_offsets(num_rows + 1);
+    compact_offsets[num_rows] = range_kept.back();
+
+    parallel_ranges(row_splits, [&](size_t t, size_t begin, size_t end) {
+        size_t position = range_kept[t];
+        for(size_t row = begin; row < end; row++)
+        {
+            size_t first = csr.offsets[row];
+            compact_offsets[row] = position;
+            std::copy(scattered.begin() + first, scattered.begin() + first + kept[row],
+                      csr.indices.begin() + position);
+            if(weighted)
+                std::copy(scattered_weights.begin() + first, scattered_weights.begin() + first + kept[row],
+                          csr.weights.begin() + position);
+            position += kept[row];
+        }
+    });
+
+    csr.offsets = std::move(compact_offsets);
+    return csr;
+}
+
+void column_sums(const CSR& csr, size_t num_cols, pr_vector<int>& counts, pr_vector<double>& weight_sums,
+                 size_t num_threads)
+{
+    num_threads = histogram_threads(num_cols, csr.num_entries(), num_threads);
+    std::vector<size_t> entry_splits = even_splits(csr.num_entries(), num_threads);
+    std::vector<std::vector<int>> local_counts(entry_splits.size() - 1);
+    std::vector<std::vector<double>> local_sums(entry_splits.size() - 1);
+
+    parallel_ranges(entry_splits, [&](size_t t, size_t begin, size_t end) {
+        local_counts[t].assign(num_cols, 0);
+        local_sums[t].assign(num_cols, 0.0);
+        for(size_t e = begin; e < end; e++)
+        {
+            int col = csr.indices[e];
+            local_counts[t][col]++;
+            local_sums[t][col] += csr.is_weighted() ? csr.weights[e] : 1.0;
+        }
+    });
+
+    /* Merged column by column in thread order */
+    counts.assign(num_cols, 0);
+    weight_sums.assign(num_cols, 0.0);
+    parallel_for(num_cols, num_threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t t = 0; t < local_counts.size(); t++)
+        {
+            for(size_t col = begin; col < end; col++)
+            {
+                counts[col]      += local_counts[t][col];
+                weight_sums[col] += local_sums[t][col];
+            }
+        }
+    });
+}
+
+std::vector<size_t> balanced_row_splits(const CSR& csr, size_t parts)
+{
+    const size_t n = csr.num_rows();
+    parts = std::max<size_t>(1, std::min(parts, n));
+
+    /*
+     * offsets[row] + row counts the rows and entries before `row`, and is
+     * increasing. The total comes from the offsets too, which build_csr
+     * splits by before the entries are filled in.
+     */
+    const size_t total = (n == 0) ? 0 : n + csr.offsets[n];
+    std::vector<size_t> splits(parts + 1, n);
+    splits[0] = 0;
+
+    size_t row = 0;
+    for(size_t t = 1; t < parts; t++)
+    {
+        size_t target = total * t / parts;
+        while(row < n && csr.offsets[row] + row < target)
+            row++;
+        splits[t] = row;
+    }
+    return splits;
+}
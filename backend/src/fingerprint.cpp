@@ -0,0 +1,419 @@
+#include "fingerprint.h"
+#include "csr.h"
+#include "graph.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/* Below this many walks per thread the build is not worth a thread start */
+static constexpr size_t FINGERPRINT_WALKS_PER_THREAD = size_t{1} << 16;
+
+static constexpr char FINGERPRINT_MAGIC[8] = {'P', 'R', 'F', 'P', 'R', 'I', 'N', 'T'};
+static constexpr uint32_t FINGERPRINT_VERSION = 1;
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/*
+ * File layout, in host byte order (the mark rejects files from the other one):
+ *
+ *     header                          64 bytes
+ *     run offsets                     (num_nodes + 1) x uint64
+ *     label offsets                   (num_nodes + 1) x uint64
+ *     endpoint runs                   run_bytes
+ *     labels                          label_bytes, not terminated
+ *
+ * The offset tables directly follow the header, so they stay 8-byte aligned
+ * in a mapping.
+ */
+struct FingerprintHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t num_nodes;
+    uint64_t walks_per_node;
+    double alpha;
+    uint64_t run_bytes;
+    uint64_t label_bytes;
+    uint64_t reserved;
+};
+static_assert(sizeof(FingerprintHeader) == 64, "fingerprint header must stay 64 bytes");
+
+static void put_varint(std::vector<unsigned char>& out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+/* Reads one varint from [p, end), throwing on a varint cut off by `end` or longer than 64 bits */
+static uint64_t get_varint(const unsigned char*& p, const unsigned char* end)
+{
+    uint64_t value = 0;
+    for(unsigned shift = 0;; shift += 7)
+    {
+        if(p == end || shift >= 64)
+            throw std::runtime_error("fingerprint index is corrupt");
+        unsigned char byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if(byte < 0x80)
+            return value;
+    }
+}
+
+/* splitmix64: one word of state, so every seed gets its own stream and a build does not depend on the threads */
+struct WalkRandom {
+    uint64_t state;
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+};
+
+FingerprintIndex::FingerprintIndex(FingerprintIndex&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+FingerprintIndex& FingerprintIndex::operator=(FingerprintIndex&& other) noexcept
+{
+    if(this == &other)
+        return *this;
+    release();
+
+    /* Moving the image keeps its buffer, so the views stay valid */
+    this->image         = std::move(other.image);
+    this->mapping       = other.mapping;
+    this->mapping_bytes = other.mapping_bytes;
+    this->data          = other.data;
+    this->offsets       = other.offsets;
+    this->num_nodes     = other.num_nodes;
+    this->walks         = other.walks;
+    this->alpha         = other.alpha;
+    this->labels        = std::move(other.labels);
+    this->label_index   = std::move(other.label_index);
+
+    other.mapping = nullptr;
+    other.mapping_bytes = 0;
+    other.data = nullptr;
+    other.offsets = nullptr;
+    other.num_nodes = 0;
+    return *this;
+}
+
+void FingerprintIndex::release() noexcept
+{
+#ifdef __linux__
+    if(this->mapping != nullptr)
+        munmap(const_cast<unsigned char*>(this->mapping), this->mapping_bytes);
+#endif
+    this->mapping = nullptr;
+    this->mapping_bytes = 0;
+}
+
+/* Checks the header against the size, then points the views into `bytes` */
+void FingerprintIndex::attach(const unsigned char* bytes, size_t size)
+{
+    FingerprintHeader header;
+    if(size < sizeof(header))
+        throw std::runtime_error("fingerprint index is truncated");
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if(std::memcmp(header.magic, FINGERPRINT_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error("not a fingerprint index");
+    if(header.version != FINGERPRINT_VERSION || header.byte_order != BYTE_ORDER_MARK)
+        throw std::runtime_error("fingerprint index of another version or byte order");
+
+    uint64_t n = header.num_nodes;
+    uint64_t tables = 2 * (n + 1) * sizeof(uint64_t);
+    if(n > size || header.run_bytes > size || header.label_bytes > size ||
+       sizeof(header) + tables + header.run_bytes + header.label_bytes != size)
+        throw std::runtime_error("fingerprint index is truncated");
+    if(n != 0 && header.walks_per_node == 0)
+        throw std::runtime_error("fingerprint index is corrupt");
+
+    this->offsets   = reinterpret_cast<const uint64_t*>(bytes + sizeof(header));
+    this->data      = bytes + sizeof(header) + tables;
+    this->num_nodes = static_cast<size_t>(n);
+    this->walks     = static_cast<size_t>(header.walks_per_node);
+    this->alpha     = header.alpha;
+
+    const uint64_t* label_offsets = this->offsets + (n + 1);
+    const char* label_bytes = reinterpret_cast<const char*>(this->data + header.run_bytes);
+    /* Both tables start at 0, never decrease and end at their section's size, so every range lies inside it */
+    if(this->offsets[0] != 0 || this->offsets[n] != header.run_bytes ||
+       label_offsets[0] != 0 || label_offsets[n] != header.label_bytes)
+        throw std::runtime_error("fingerprint index is corrupt");
+    for(size_t v = 0; v < n; v++)
+    {
+        if(this->offsets[v] > this->offsets[v + 1] || label_offsets[v] > label_offsets[v + 1])
+            throw std::runtime_error("fingerprint index is corrupt");
+    }
+
+    this->labels.clear();
+    this->labels.reserve(this->num_nodes);
+    this->label_index = LabelIndex();
+    this->label_index.reserve(this->num_nodes);
+    for(size_t v = 0; v < this->num_nodes; v++)
+    {
+        this->labels.emplace_back(label_bytes + label_offsets[v], label_offsets[v + 1] - label_offsets[v]);
+        this->label_index.insert(LabelIndex::hash(this->labels.back()), static_cast<int>(v));
+    }
+}
+
+FingerprintIndex FingerprintIndex::from_runs(const std::vector<std::string>& labels, size_t walks_per_node,
+                                             double alpha, const std::vector<uint64_t>& run_offsets,
+                                             const std::vector<unsigned char>& runs)
+{
+    const size_t n = labels.size();
+    uint64_t label_bytes = 0;
+    for(const std::string& label : labels)
+        label_bytes += label.size();
+
+    FingerprintHeader header{};
+    std::memcpy(header.magic, FINGERPRINT_MAGIC, sizeof(header.magic));
+    header.version        = FINGERPRINT_VERSION;
+    header.byte_order     = BYTE_ORDER_MARK;
+    header.num_nodes      = n;
+    header.walks_per_node = walks_per_node;
+    header.alpha          = alpha;
+    header.run_bytes      = runs.size();
+    header.label_bytes    = label_bytes;
+
+    const size_t tables = 2 * (n + 1) * sizeof(uint64_t);
+    FingerprintIndex index;
+    index.image.resize(sizeof(header) + tables + runs.size() + label_bytes);
+    unsigned char* out = index.image.data();
+
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), run_offsets.data(), (n + 1) * sizeof(uint64_t));
+
+    uint64_t* label_offsets = reinterpret_cast<uint64_t*>(out + sizeof(header)) + (n + 1);
+    unsigned char* label_out = out + sizeof(header) + tables + runs.size();
+    label_offsets[0] = 0;
+    for(size_t v = 0; v < n; v++)
+    {
+        std::memcpy(label_out + label_offsets[v], labels[v].data(), labels[v].size());
+        label_offsets[v + 1] = label_offsets[v] + labels[v].size();
+    }
+    std::memcpy(out + sizeof(header) + tables, runs.data(), runs.size());
+
+    index.attach(index.image.data(), index.image.size());
+    return index;
+}
+
+void FingerprintIndex::save(const std::string& path) const
+{
+    const unsigned char* bytes = is_mapped() ? this->mapping : this->image.data();
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if(file == nullptr)
+        throw std::runtime_error("cannot open " + path + " for writing");
+
+    bool written = std::fwrite(bytes, 1, size_bytes(), file) == size_bytes();
+    written = (std::fclose(file) == 0) && written;
+    if(!written)
+        throw std::runtime_error("cannot write " + path);
+}
+
+FingerprintIndex FingerprintIndex::load(const std::string& path)
+{
+    FingerprintIndex index;
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("cannot open " + path);
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("cannot read " + path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+
+    index.mapping = static_cast<const unsigned char*>(mapped);
+    index.mapping_bytes = size;
+    index.attach(index.mapping, size);
+#else
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr)
+        throw std::runtime_error("cannot open " + path);
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    index.image.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool read = std::fread(index.image.data(), 1, index.image.size(), file) == index.image.size();
+    std::fclose(file);
+    if(!read)
+        throw std::runtime_error("cannot read " + path);
+    index.attach(index.image.data(), index.image.size());
+#endif
+
+    #ifdef DEBUG
+        std::cout << "Loaded fingerprint index: " << index.num_nodes << " nodes, "
+                  << index.walks << " walks each, " << index.size_bytes() << " bytes" << std::endl;
+    #endif
+    return index;
+}
+
+std::vector<std::pair<int, double>> FingerprintIndex::top_k(int seed, size_t k) const
+{
+    std::vector<std::pair<int, double>> top;
+    if(seed < 0 || static_cast<size_t>(seed) >= this->num_nodes)
+        return top;
+
+    /* (node, count) runs in node order, nodes as gaps from the previous one */
+    std::vector<std::pair<int, uint64_t>> counts;
+    const unsigned char* p   = this->data + this->offsets[seed];
+    const unsigned char* end = this->data + this->offsets[seed + 1];
+    uint64_t node = 0;
+    while(p < end)
+    {
+        uint64_t gap = get_varint(p, end);
+        if(gap >= this->num_nodes - node)
+            throw std::runtime_error("fingerprint index is corrupt");
+        node += gap;
+        counts.emplace_back(static_cast<int>(node), get_varint(p, end) + 1);
+    }
+
+    auto better = [](const std::pair<int, uint64_t>& a, const std::pair<int, uint64_t>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    if(k == 0 || k > counts.size())
+        k = counts.size();
+    std::partial_sort(counts.begin(), counts.begin() + k, counts.end(), better);
+
+    top.reserve(k);
+    for(size_t i = 0; i < k; i++)
+        top.emplace_back(counts[i].first, static_cast<double>(counts[i].second) / static_cast<double>(this->walks));
+    return top;
+}
+
+std::vector<std::pair<std::string, double>> FingerprintIndex::top_k(std::string_view seed, size_t k) const
+{
+    std::vector<std::pair<std::string, double>> top;
+    for(const std::pair<int, double>& entry : top_k(this->label_index.find(seed, this->labels), k))
+        top.emplace_back(this->labels[entry.first], entry.second);
+    return top;
+}
+
+/*
+ * Runs the walks of every seed on its own thread's share of the seeds, over
+ * the out-links (weighted links are taken in proportion to their weight by a
+ * binary search over the row's running total). Each thread encodes its seeds'
+ * runs into its own buffer; the buffers are concatenated in seed order.
+ */
+FingerprintIndex Graph::build_fingerprint_index(const FingerprintOptions& options)
+{
+    build_sparse();
+
+    const size_t n = this->num_nodes;
+    const size_t walks = std::max<size_t>(options.walks_per_node, 1);
+    const double alpha = this->ALPHA;
+    const bool weighted = is_weighted();
+
+    CSR out_links = build_csr(n, this->edge_src, this->edge_dest, weighted ? &this->edge_weight : nullptr,
+                              threads_for(this->edge_src.size(), SPARSE_WORK_PER_THREAD));
+
+    pr_vector<double> running_total;
+    if(weighted)
+    {
+        running_total.resize(out_links.num_entries());
+        for(size_t u = 0; u < n; u++)
+        {
+            double total = 0.0;
+            for(size_t e = out_links.offsets[u]; e < out_links.offsets[u + 1]; e++)
+                running_total[e] = (total += out_links.weights[e]);
+        }
+    }
+
+    size_t threads = options.num_threads != 0 ? options.num_threads : threads_for(n * walks, FINGERPRINT_WALKS_PER_THREAD);
+    std::vector<size_t> splits = even_splits(n, threads);
+    std::vector<std::vector<unsigned char>> chunk_runs(splits.size() - 1);
+    std::vector<uint64_t> run_offsets(n + 1, 0);
+
+    parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+        std::vector<unsigned char>& runs = chunk_runs[t];
+        std::vector<int> endpoints(walks);
+
+        for(size_t s = begin; s < end; s++)
+        {
+            WalkRandom random{options.seed ^ (static_cast<uint64_t>(s) * 0xD1B54A32D192ED03ull)};
+            for(size_t w = 0; w < walks; w++)
+            {
+                size_t node = s;
+                while(random.uniform() < alpha)
+                {
+                    size_t first  = out_links.offsets[node];
+                    size_t degree = out_links.offsets[node + 1] - first;
+                    if(degree == 0)
+                        node = s;
+                    else if(!weighted)
+                        node = static_cast<size_t>(out_links.indices[first + random.next() % degree]);
+                    else
+                    {
+                        const double* row = running_total.data() + first;
+                        double target = random.uniform() * row[degree - 1];
+                        size_t pick = std::upper_bound(row, row + degree, target) - row;
+                        node = static_cast<size_t>(out_links.indices[first + std::min(pick, degree - 1)]);
+                    }
+                }
+                endpoints[w] = static_cast<int>(node);
+            }
+
+            std::sort(endpoints.begin(), endpoints.end());
+            int previous = 0;
+            for(size_t w = 0; w < walks;)
+            {
+                size_t run_end = w;
+                while(run_end < walks && endpoints[run_end] == endpoints[w])
+                    run_end++;
+                put_varint(runs, static_cast<uint64_t>(endpoints[w] - previous));
+                put_varint(runs, run_end - w - 1);
+                previous = endpoints[w];
+                w = run_end;
+            }
+            run_offsets[s + 1] = runs.size();
+        }
+    });
+
+    /* Thread-local offsets become global by adding the bytes of the earlier chunks */
+    std::vector<unsigned char> runs;
+    for(size_t t = 0; t + 1 < splits.size(); t++)
+    {
+        uint64_t base = runs.size();
+        for(size_t s = splits[t]; s < splits[t + 1]; s++)
+            run_offsets[s + 1] += base;
+        runs.insert(runs.end(), chunk_runs[t].begin(), chunk_runs[t].end());
+        std::vector<unsigned char>().swap(chunk_runs[t]);
+    }
+
+    #ifdef DEBUG
+        std::cout << "Fingerprint index: " << n << " seeds, " << walks << " walks each, "
+                  << runs.size() << " bytes of runs, " << splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    return FingerprintIndex::from_runs(this->index_to_node, walks, alpha, run_offsets, runs);
+}
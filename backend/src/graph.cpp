@@ -1,15 +1,44 @@
 #include "graph.h"
+#include "convergence.h"
+#include "parallel.h"
+#include "summation.h"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 #ifdef DEBUG 
     #include <iomanip>
     #include <iostream>
 #endif
 
+/* Below this many nodes per thread the statistics pass is not worth a thread start */
+static constexpr size_t STATS_NODES_PER_THREAD = size_t{1} << 15;
+
+/* Below this many edges per thread the reciprocity searches are not worth a thread start */
+static constexpr size_t STRUCTURE_EDGES_PER_THREAD = size_t{1} << 15;
+
+/* Below this many edges per thread the CSR build is not worth a thread start */
+static constexpr size_t CSR_EDGES_PER_THREAD = size_t{1} << 16;
+
+/* Below this many labels per thread bulk hashing is not worth a thread start */
+static constexpr size_t LABELS_PER_THREAD = size_t{1} << 13;
+
+/* Fewer expected power iterations than this and Gauss-Seidel has little to save */
+static constexpr double GAUSS_SEIDEL_MIN_ITERATIONS = 8.0;
+
+/* Below this share of dangling nodes the lumped system is not worth building */
+static constexpr double LUMP_MIN_DANGLING_FRACTION = 0.05;
+
+/* From this share of all possible edges on, lookups over the adjacency bits beat the gather */
+static constexpr double BITSET_MIN_DENSITY = 0.2;
+
 void Graph::add_node(const std::string& lbl)
 {
-    /* Check if node already exists in the adj matrix */
-    if (this->node_to_index.find(lbl) != this->node_to_index.end()) {
+    /* Check if node already exists in the graph */
+    uint64_t hash = LabelIndex::hash(lbl);
+    if (this->label_index.find(lbl, hash, this->index_to_node) != -1) {
         /* Node already exists */
         #if DEBUG 
             std::cout << "Node " << lbl << " already exists in the graph." << std::endl;
@@ -18,8 +47,8 @@ void Graph::add_node(const std::string& lbl)
     }
     
     /* Maps the node label to the next available index */ 
-    /* Example: If the graph is empty and we add node "A", then node_to_index["A"] = 0 */
-    node_to_index[lbl] = this->num_nodes;
+    /* Example: If the graph is empty and we add node "A", then "A" maps to 0 */
+    label_index.insert(hash, static_cast<int>(this->num_nodes));
 
     /* Maps the index back to the node label 
      * Example: 0 -> "A" 
@@ -27,17 +56,16 @@ void Graph::add_node(const std::string& lbl)
     index_to_node.push_back(lbl);
 
     this->num_nodes += 1;
-
-    adj.resize(this->num_nodes);
-    for(size_t i = 0; i < this->num_nodes; i++)
-        adj[i].resize(this->num_nodes, 0);
+    this->sparse_dirty = true;
 }
 
-void Graph::add_edge(const std::string& src, const std::string& dest)
+void Graph::add_edge(const std::string& src, const std::string& dest, double weight)
 {
+    int src_index   = this->label_index.find(src, this->index_to_node);
+    int dest_index  = this->label_index.find(dest, this->index_to_node);
+
     /* Ensure both nodes exist in the graph */
-    if(this->node_to_index.find(src) == this->node_to_index.end() ||
-       this->node_to_index.find(dest) == this->node_to_index.end())
+    if(src_index == -1 || dest_index == -1)
     {
         /* One or both nodes do not exist */
         #if DEBUG 
@@ -47,70 +75,261 @@ void Graph::add_edge(const std::string& src, const std::string& dest)
         return;
     }
 
-    int src_index   = this->node_to_index[src];
-    int dest_index  = this->node_to_index[dest];
+    /* Only positive weights describe a transition probability */
+    if(!(weight > 0.0) || !std::isfinite(weight))
+    {
+        #if DEBUG 
+            std::cout << "Invalid edge weight " << weight << " for edge: " << src << ", " << dest << std::endl;
+        #endif
 
-    /* Add the edge to the adjacency matrix */
-    this->adj[src_index][dest_index] = 1;
-    
-    /* Add to edge vector */
-    this->edges.push_back({src, dest});
+        return;
+    }
+
+    /* The weights array only exists once a weight other than 1 has been seen */
+    if(weight != 1.0 || !this->edge_weight.empty())
+    {
+        if(this->edge_weight.empty())
+            this->edge_weight.assign(this->edge_src.size(), 1.0);
+        this->edge_weight.push_back(weight);
+    }
+
+    /* Add to edge vectors, the sparse storage is rebuilt from these on the next solve */
+    this->edge_src.push_back(src_index);
+    this->edge_dest.push_back(dest_index);
+    this->sparse_dirty = true;
 
     return;
 }
 
-void Graph::compute_out_degrees(std::vector<int>& out_degrees)
+void Graph::add_nodes(const std::vector<std::string_view>& labels)
+{
+    /* Hashing is the expensive part and needs no shared state */
+    std::vector<uint64_t> hashes(labels.size());
+    parallel_for(labels.size(), threads_for(labels.size(), LABELS_PER_THREAD), [&](size_t, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            hashes[i] = LabelIndex::hash(labels[i]);
+    });
+
+    this->label_index.reserve(this->num_nodes + labels.size());
+    this->index_to_node.reserve(this->num_nodes + labels.size());
+
+    /* Inserted in order, so indices follow the list and repeats keep their first index */
+    for(size_t i = 0; i < labels.size(); i++)
+    {
+        if(this->label_index.find(labels[i], hashes[i], this->index_to_node) != -1)
+            continue;
+
+        this->label_index.insert(hashes[i], static_cast<int>(this->num_nodes));
+        this->index_to_node.emplace_back(labels[i]);
+        this->num_nodes += 1;
+        this->sparse_dirty = true;
+    }
+}
+
+void Graph::resolve_labels(const std::vector<std::string_view>& labels, int64_t* indices) const
+{
+    parallel_for(labels.size(), threads_for(labels.size(), LABELS_PER_THREAD), [&](size_t, size_t begin, size_t end) {
+        this->label_index.find_batch(labels.data() + begin, end - begin, indices + begin, this->index_to_node);
+    });
+}
+
+size_t Graph::add_edges_by_label(const std::vector<std::string_view>& src, const std::vector<std::string_view>& dest)
+{
+    if(src.size() != dest.size())
+        throw std::invalid_argument("source and destination lists differ in length");
+
+    std::vector<int64_t> src_index(src.size());
+    std::vector<int64_t> dest_index(dest.size());
+    resolve_labels(src, src_index.data());
+    resolve_labels(dest, dest_index.data());
+
+    this->edge_src.reserve(this->edge_src.size() + src.size());
+    this->edge_dest.reserve(this->edge_dest.size() + dest.size());
+
+    /* Edges with an unknown endpoint are skipped, as in add_edge() */
+    size_t added = 0;
+    for(size_t i = 0; i < src.size(); i++)
+    {
+        if(src_index[i] == -1 || dest_index[i] == -1)
+            continue;
+
+        this->edge_src.push_back(static_cast<int>(src_index[i]));
+        this->edge_dest.push_back(static_cast<int>(dest_index[i]));
+        if(!this->edge_weight.empty())
+            this->edge_weight.push_back(1.0);
+        added++;
+    }
+
+    #ifdef DEBUG
+        if(added != src.size())
+            std::cout << src.size() - added << " edges had an unknown endpoint and were skipped." << std::endl;
+    #endif
+
+    if(added != 0)
+        this->sparse_dirty = true;
+    return added;
+}
+
+std::vector<std::pair<std::string, std::string>> Graph::get_edges() const
+{
+    std::vector<std::pair<std::string, std::string>> edges;
+    edges.reserve(this->edge_src.size());
+
+    for(size_t i = 0; i < this->edge_src.size(); i++)
+        edges.push_back({this->index_to_node[this->edge_src[i]], this->index_to_node[this->edge_dest[i]]});
+
+    return edges;
+}
+
+void Graph::build_sparse()
+{
+    if(!this->sparse_dirty)
+        return;
+
+    build_sparse(threads_for(this->edge_src.size(), CSR_EDGES_PER_THREAD));
+}
+
+/* As above on at most `threads` threads, 1 when the caller already runs builds side by side */
+void Graph::build_sparse(size_t threads)
+{
+    if(!this->sparse_dirty)
+        return;
+
+    /* Transposed storage: row v lists every u with an edge u -> v, repeated edges collapse */
+    this->in_links = build_csr(this->num_nodes, this->edge_dest, this->edge_src,
+                               is_weighted() ? &this->edge_weight : nullptr, threads);
+
+    finish_sparse(threads);
+}
+
+void Graph::finish_sparse(size_t threads)
 {
+    /* Out-degrees count distinct links, the normalization uses their total weight */
+    pr_vector<double> out_weights;
+    column_sums(this->in_links, this->num_nodes, this->out_degrees, out_weights, threads);
+
+    this->inv_out_degrees.resize(this->num_nodes);
     for(size_t i = 0; i < this->num_nodes; i++)
+        this->inv_out_degrees[i] = (this->out_degrees[i] == 0) ? 0.0 : 1.0 / out_weights[i];
+
+    /* Degree statistics are cheap next to the build and every solver consults them */
+    this->stats = compute_graph_stats(this->in_links, this->out_degrees,
+                                      std::min(threads, threads_for(this->num_nodes, STATS_NODES_PER_THREAD)));
+    this->structure_dirty = true;
+
+    /* Any dense copy and reduction are now stale */
+    this->adj_bits = BitMatrix{};
+    this->reduction = GraphReduction{};
+    this->reduction_dirty = true;
+    this->sparse_dirty = false;
+}
+
+void Graph::finalize()
+{
+    build_sparse();
+}
+
+const GraphStats& Graph::get_statistics()
+{
+    build_sparse();
+
+    /* Reciprocity and SCCs only matter to the caller, the solvers never read them */
+    if(this->structure_dirty)
     {
-        int out_degree = 0;
-        for(size_t j = 0; j < this->num_nodes; j++)
-        {
-            out_degree += this->adj[i][j];
-        }
-        out_degrees[i] = out_degree;
+        compute_structure_stats(this->in_links, this->stats,
+                                threads_for(this->in_links.num_entries(), STRUCTURE_EDGES_PER_THREAD));
+        this->structure_dirty = false;
     }
+    return this->stats;
 }
 
-std::vector<std::vector<double>> Graph::build_transition_matrix()
+void Graph::fill_teleport_vector(const PageRankOptions& options, double* teleport) const
 {
-    /* Compute out-degrees */
-    std::vector<int> out_degrees (num_nodes, 0);
-    compute_out_degrees(out_degrees);
-    
-    /* Init transition matrix */
-    std::vector<std::vector<double>> transition_matrix ;
-    
-    transition_matrix.resize(this->num_nodes);
+    double total = 0.0;
     for(size_t i = 0; i < this->num_nodes; i++)
-        transition_matrix[i].resize(this->num_nodes);
+        teleport[i] = 0.0;
+
+    /* Unknown labels and non-positive weights are ignored, like edges to unknown nodes */
+    for(const auto& pair : options.personalization)
+    {
+        int index = this->label_index.find(pair.first, this->index_to_node);
+        if(index == -1 || !(pair.second > 0.0))
+            continue;
+
+        teleport[index] += pair.second;
+        total += pair.second;
+    }
 
-    /* Build translation matrix */
-    for(size_t row = 0; row < this->num_nodes; row++)
+    if(total <= 0.0)
     {
-        for(size_t col = 0; col < this->num_nodes; col++)
+        for(size_t i = 0; i < this->num_nodes; i++)
+            teleport[i] = 1.0 / static_cast<double>(this->num_nodes);
+        return;
+    }
+
+    for(size_t i = 0; i < this->num_nodes; i++)
+        teleport[i] /= total;
+}
+
+pr_vector<double> Graph::build_teleport_vector(const PageRankOptions& options) const
+{
+    pr_vector<double> teleport(this->num_nodes);
+    fill_teleport_vector(options, teleport.data());
+    return teleport;
+}
+
+/*
+ * Google matrix G = ALPHA * S + (1 - ALPHA) * t 1^T in one contiguous matrix,
+ * written row by row straight from the in-links: row v starts at its teleport
+ * term (1 - ALPHA) t[v] and its dangling terms, then gains ALPHA w / out(u) for
+ * every in-link u -> v. Rows are independent, so they are filled in parallel.
+ */
+DenseMatrix Graph::build_google_matrix(const PageRankOptions& options, size_t threads)
+{
+    build_sparse();
+    const size_t n = this->num_nodes;
+    const pr_vector<double> teleport = build_teleport_vector(options);
+    const std::vector<int>& dangling_nodes = this->stats.dangling_nodes;
+
+    DenseMatrix google_matrix(n, n);
+    parallel_ranges(even_splits(n, threads), [&](size_t, size_t begin, size_t end) {
+        for(size_t row = begin; row < end; row++)
         {
-            if(out_degrees[row] == 0)
+            double* g_row = google_matrix.row(row);
+            std::fill(g_row, g_row + n, (1.0 - this->ALPHA) * teleport[row]);
+
+            /* Dangling columns */
+            for(int src : dangling_nodes)
             {
-                transition_matrix[col][row] = static_cast<double>(1.0/this->num_nodes);
+                switch(options.dangling)
+                {
+                    case DanglingPolicy::TELEPORT:
+                        g_row[src] += this->ALPHA * teleport[row];
+                        break;
+                    case DanglingPolicy::SELF_LOOP:
+                        g_row[src] += (static_cast<size_t>(src) == row) ? this->ALPHA : 0.0;
+                        break;
+                    default:
+                        g_row[src] += this->ALPHA * (1.0 / static_cast<double>(n));
+                        break;
+                }
             }
-            else 
+
+            for(size_t e = this->in_links.offsets[row]; e < this->in_links.offsets[row + 1]; e++)
             {
-                transition_matrix[col][row] = static_cast<double>(this->adj[row][col]) / static_cast<double>(out_degrees[row]);
+                int src = this->in_links.indices[e];
+                double weight = this->in_links.is_weighted() ? this->in_links.weights[e] : 1.0;
+                g_row[src] += this->ALPHA * weight * this->inv_out_degrees[src];
             }
         }
-    }
+    });
 
     #ifdef DEBUG
-        // Create index-to-label mapping for printing
-        std::vector<std::string> labels(num_nodes);
-        for(const auto& pair : node_to_index)
-        {
-            labels[pair.second] = pair.first;
-        }
+        // Labels for printing
+        const std::vector<std::string>& labels = this->index_to_node;
 
         // Pretty print with labels
-        std::cout << "\n\t=== Transition Matrix (Column-Stochastic) ===" << std::endl;
+        std::cout << "\n\t=== Google Matrix (Column-Stochastic) ===" << std::endl;
         std::cout << std::fixed << std::setprecision(4);
         
         // Print column headers
@@ -127,183 +346,364 @@ std::vector<std::vector<double>> Graph::build_transition_matrix()
             std::cout << std::setw(2) << labels[i] << " [ ";
             for(size_t j = 0; j < this->num_nodes; j++)
             {
-                std::cout << std::setw(8) << transition_matrix[i][j];
+                std::cout << std::setw(8) << google_matrix.row(i)[j];
                 if(j < num_nodes - 1) std::cout << ", ";
             }
             std::cout << " ]" << std::endl;
         }
         std::cout << std::endl;
     #endif
-    return transition_matrix;
+    return google_matrix;
 }
 
-std::vector<std::vector<double>> Graph::build_teleportation_matrix()
+/* Rows of G each dense_rows call covers, reading every score once for all of them */
+static constexpr size_t DENSE_BLOCK_ROWS = 4;
+
+/* r_new[row] = G[row] . r_old for rows [begin, end), four rows per pass over r_old */
+template <Summation S>
+static void dense_rows(const DenseMatrix& google_matrix, const double* r_old, double* r_new, size_t begin, size_t end)
 {
-    std::vector<std::vector<double>> teleportation_matrix;
-    teleportation_matrix.resize(this->num_nodes);
+    const size_t n = google_matrix.num_cols();
+    size_t row = begin;
+    for(; row + DENSE_BLOCK_ROWS <= end; row += DENSE_BLOCK_ROWS)
+        dot_rows<S, DENSE_BLOCK_ROWS>(google_matrix.row(row), google_matrix.stride(), r_old, n, r_new + row);
+    for(; row < end; row++)
+        r_new[row] = dot<S>(google_matrix.row(row), r_old, n);
+}
 
-    for(size_t i = 0; i < this->num_nodes; i++)
-        teleportation_matrix[i].resize(this->num_nodes, static_cast<double>(1.0/this->num_nodes));
+/*
+ * One dense power-iteration step, r_new = G * r_old.
+ * Rows are split over threads in whole blocks. When measuring, each thread
+ * accumulates the residual of its rows while they are written, and the partial
+ * residuals are merged in row order, so the result does not depend on timing.
+ */
+template <Summation S>
+static double dense_step(const DenseMatrix& google_matrix, const std::vector<size_t>& splits,
+                         ConvergenceNorm norm, bool measure,
+                         const pr_vector<double>& r_old,
+                         pr_vector<double>& r_new)
+{
+    std::vector<Residual<S>> partial(splits.size() - 1);
 
-    #ifdef DEBUG
-        // Create index-to-label mapping for printing
-        std::vector<std::string> labels(num_nodes);
-        for(const auto& pair : node_to_index)
-        {
-            labels[pair.second] = pair.first;
-        }
+    parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+        dense_rows<S>(google_matrix, r_old.data(), r_new.data(), begin, end);
 
-        // Pretty print with labels
-        std::cout << "\n\t=== Teleportation Matrix (Column-Stochastic) ===" << std::endl;
-        std::cout << std::fixed << std::setprecision(4);
-        
-        // Print column headers
-        std::cout << " ";  // Space for row labels
-        for(size_t j = 0; j < this->num_nodes; j++)
+        if(measure)
         {
-            std::cout << std::setw(10) << labels[j];
+            for(size_t row = begin; row < end; row++)
+                partial[t].add(r_old[row], r_new[row]);
         }
-        std::cout << std::endl;
-        
-        // Print matrix with row labels
-        for(size_t i = 0; i < this->num_nodes; i++)
-        {
-            std::cout << std::setw(2) << labels[i] << " [ ";
-            for(size_t j = 0; j < this->num_nodes; j++)
-            {
-                std::cout << std::setw(8) << teleportation_matrix[i][j];
-                if(j < num_nodes - 1) std::cout << ", ";
-            }
-            std::cout << " ]" << std::endl;
-        }
-        std::cout << std::endl;
-    #endif
-    return teleportation_matrix;
+    });
+
+    Residual<S> residual;
+    for(const Residual<S>& part : partial)
+        residual.merge(part);
+    return residual.value(norm);
 }
 
-std::vector<std::vector<double>> Graph::build_google_matrix()
+/*
+ * One in-place Gauss-Seidel sweep over (I - G) r = 0.
+ * Each entry is solved for using the entries already updated in this sweep,
+ * so only a single vector is needed. The sweep does not preserve the sum of r,
+ * so it is renormalized afterwards.
+ */
+template <Summation S>
+static double dense_sweep(const DenseMatrix& google_matrix, ConvergenceNorm norm, bool measure,
+                          pr_vector<double>& r)
 {
-    auto transition_matrix    = build_transition_matrix();
-    auto teleportation_matrix  = build_teleportation_matrix();
-        
-    /* Initialize Googel matrix */
-    std::vector<std::vector<double>> google_matrix;
-    google_matrix.resize(this->num_nodes); 
-    for(size_t i = 0; i < this->num_nodes; i++)
-        google_matrix[i].resize(this->num_nodes, 0.0);
-    
-    /* Compute PageRank matrix */
-    for(size_t row = 0; row < this->num_nodes; row++)
+    Residual<S> residual;
+    Accumulator<S> total;
+    const size_t n = r.size();
+
+    for(size_t row = 0; row < n; row++)
     {
-        for(size_t col = 0; col < this->num_nodes; col++)
-        {
-            google_matrix[row][col] =
-                ((this->ALPHA) * transition_matrix[row][col]) + 
-                ((1.0 - this->ALPHA) * teleportation_matrix[row][col]);
-        }
+        const double* g_row = google_matrix.row(row);
+        double sum = dot<S>(g_row, r.data(), n);
+
+        /* Remove the diagonal term and solve for r[row] */
+        double off_diagonal = sum - g_row[row] * r[row];
+        double denominator  = 1.0 - g_row[row];
+        double updated      = (denominator > 0.0) ? off_diagonal / denominator : r[row];
+
+        if(measure)
+            residual.add(r[row], updated);
+
+        r[row] = updated;
+        total.add(updated);
     }
 
+    double scale = 1.0 / total.value();
+    for(size_t row = 0; row < n; row++)
+        r[row] *= scale;
+
+    return residual.value(norm);
+}
+
+struct PageRankResult Graph::compute_pagerank()
+{
+    return compute_pagerank(PageRankOptions{});
+}
+
+/* Whether the adjacency bits are built or would fit the memory budget */
+bool Graph::adjacency_bits_fit() const
+{
+    return this->memory_budget == 0 || !this->adj_bits.empty() ||
+           memory_usage().total() + BitMatrix::bytes_for(this->num_nodes, this->num_nodes) <= this->memory_budget;
+}
+
+/* Lumping needs dangling nodes to redistribute along the teleport vector */
+bool Graph::can_lump(const PageRankOptions& options)
+{
+    return options.dangling == DanglingPolicy::TELEPORT ||
+           (options.dangling == DanglingPolicy::UNIFORM && options.personalization.empty());
+}
+
+/*
+ * Fills in Solver::AUTO from the cached statistics and the damping factor:
+ *
+ *  - up to SMALL_GRAPH_MAX nodes the unrolled fixed-size kernel wins outright;
+ *  - unweighted graphs with at least BITSET_MIN_DENSITY of all possible
+ *    edges go to the bitset solver, whose lookups cost n^2 / 8 per step
+ *    against one per edge for the gather, unless the bits exceed the
+ *    memory budget;
+ *  - everything else goes to the sparse solver, which beat the dense one at
+ *    every size and density measured, since the dense solver builds n x n
+ *    matrices on every call;
+ *  - when the graph is too small to split across threads, Gauss-Seidel
+ *    sweeps converge in fewer iterations than Jacobi steps at no extra cost
+ *    per iteration. Below GAUSS_SEIDEL_MIN_ITERATIONS expected power
+ *    iterations (low damping) there is too little left to save;
+ *  - when dangling nodes hand their score to the teleport vector and at least
+ *    LUMP_MIN_DANGLING_FRACTION of the nodes are dangling, the lumped solver
+ *    drops them from every iteration, unless the caller asked for
+ *    Gauss-Seidel sweeps under a personalization vector;
+ *  - an accelerated solve needs Jacobi steps on the sparse solver, which is
+ *    the only one that extrapolates.
+ *
+ * Options the caller set explicitly (in_place, num_threads) are kept.
+ */
+PageRankOptions Graph::plan_solve(const PageRankOptions& options)
+{
+    PageRankOptions plan = options;
+    build_sparse();
+    const GraphStats& stats = this->stats;
+
+    if(stats.num_nodes <= SMALL_GRAPH_MAX && !options.in_place && options.precision == Precision::DOUBLE)
+    {
+        plan.solver = Solver::SMALL;
+        return plan;
+    }
+
+    bool accelerated = (options.acceleration != Acceleration::NONE);
+    double density = static_cast<double>(stats.num_edges) /
+                     (static_cast<double>(stats.num_nodes) * static_cast<double>(stats.num_nodes));
+    if(!accelerated && !is_weighted() && density >= BITSET_MIN_DENSITY && adjacency_bits_fit())
+    {
+        #ifdef DEBUG
+            std::cout << "Auto solver: bitset, density " << density << std::endl;
+        #endif
+        plan.solver   = Solver::BITSET;
+        plan.in_place = false;
+        return plan;
+    }
+
+    /* Lumped sweeps diverge under a personalization vector, a caller asking for sweeps keeps every node */
+    bool personalized_sweeps = (options.in_place && !options.personalization.empty());
+    plan.solver = Solver::SPARSE;
+    if(!accelerated && !personalized_sweeps && can_lump(options) && stats.dangling_fraction() >= LUMP_MIN_DANGLING_FRACTION)
+        plan.solver = Solver::LUMPED;
+
+    /* The power iteration error shrinks by about ALPHA per step */
+    double expected_iterations = std::log(this->EPSILON) / std::log(this->ALPHA);
+
+    size_t threads = options.num_threads != 0 ? options.num_threads
+                                              : threads_for(stats.num_nodes + stats.num_edges, SPARSE_WORK_PER_THREAD);
+    /* Lumped sweeps see the dangling mass one sweep late, which a concentrated teleport vector feels */
+    bool lumped_personalized = (plan.solver == Solver::LUMPED && !options.personalization.empty());
+    if(threads == 1 && expected_iterations >= GAUSS_SEIDEL_MIN_ITERATIONS && !lumped_personalized && !accelerated)
+        plan.in_place = true;
+
     #ifdef DEBUG
-        // Create index-to-label mapping for printing
-        std::vector<std::string> labels(num_nodes);
-        for(const auto& pair : node_to_index)
-        {
-            labels[pair.second] = pair.first;
-        }
+        std::cout << "Auto solver: " << (plan.solver == Solver::LUMPED ? "lumped" : "sparse")
+                  << (plan.in_place ? " (Gauss-Seidel)" : "") << ", "
+                  << threads << " threads" << std::endl;
+    #endif
 
-        // Pretty print with labels
-        std::cout << "\n\t=== Google Matrix (Column-Stochastic) ===" << std::endl;
-        std::cout << std::fixed << std::setprecision(4);
-        
-        // Print column headers
-        std::cout << " ";  // Space for row labels
-        for(size_t j = 0; j < this->num_nodes; j++)
-        {
-            std::cout << std::setw(10) << labels[j];
-        }
-        std::cout << std::endl;
-        
-        // Print matrix with row labels
-        for(size_t i = 0; i < this->num_nodes; i++)
+    return plan;
+}
+
+struct PageRankResult Graph::compute_pagerank(const PageRankOptions& options)
+{
+    /* Every parallel pass of the solve runs on one set of threads */
+    WorkerScope workers;
+
+    PageRankOptions plan = (options.solver == Solver::AUTO) ? plan_solve(options) : options;
+
+    /* Interactive-sized graphs take the fixed-size path, larger ones fall back to the dense solver */
+    if(plan.solver == Solver::DENSE && this->num_nodes <= SMALL_GRAPH_MAX && !plan.in_place)
+        plan.solver = Solver::SMALL;
+    if(plan.solver == Solver::SMALL && this->num_nodes > SMALL_GRAPH_MAX)
+        plan.solver = Solver::DENSE;
+
+    /* A dense solve over the budget runs on the sparse storage instead */
+    if(plan.solver == Solver::DENSE && this->memory_budget != 0 &&
+       memory_usage().total() + dense_memory(this->num_nodes) > this->memory_budget)
+    {
+        #ifdef DEBUG
+            std::cout << "Dense matrix of " << dense_memory(this->num_nodes)
+                      << " bytes exceed the memory budget, using the sparse solver." << std::endl;
+        #endif
+        plan.solver = Solver::SPARSE;
+    }
+
+    /* Dangling scores that do not follow the teleport vector cannot be lumped */
+    if(plan.solver == Solver::LUMPED && !can_lump(plan))
+    {
+        #ifdef DEBUG
+            std::cout << "Dangling policy does not allow lumping, using the sparse solver." << std::endl;
+        #endif
+        plan.solver = Solver::SPARSE;
+    }
+
+    /*
+     * The lumped teleport term is fixed from the mass of the last sweep. A
+     * Gauss-Seidel sweep under a concentrated teleport vector runs ahead of
+     * it and diverges, so personalized sweeps run over every node instead.
+     */
+    if(plan.solver == Solver::LUMPED && plan.in_place && !plan.personalization.empty())
+    {
+        #ifdef DEBUG
+            std::cout << "Lumped sweeps diverge under a personalization vector, using the sparse solver." << std::endl;
+        #endif
+        plan.solver = Solver::SPARSE;
+    }
+
+    /* Lumped and reduced solves iterate over part of the nodes, a top-k ranking needs every score */
+    if(plan.top_k != 0 && (plan.solver == Solver::LUMPED || plan.reduce))
+    {
+        #ifdef DEBUG
+            std::cout << "Top-k termination watches every score, solving unlumped and unreduced." << std::endl;
+        #endif
+        if(plan.solver == Solver::LUMPED)
+            plan.solver = Solver::SPARSE;
+        plan.reduce = false;
+    }
+
+    /* Lookups over bits need an unweighted graph whose bits fit the budget, and run Jacobi steps */
+    if(plan.solver == Solver::BITSET)
+    {
+        if(is_weighted() || !adjacency_bits_fit())
         {
-            std::cout << std::setw(2) << labels[i] << " [ ";
-            for(size_t j = 0; j < this->num_nodes; j++)
-            {
-                std::cout << std::setw(8) << google_matrix[i][j];
-                if(j < num_nodes - 1) std::cout << ", ";
-            }
-            std::cout << " ]" << std::endl;
+            #ifdef DEBUG
+                std::cout << "Bitset solver needs an unweighted graph within the memory budget, using the sparse solver." << std::endl;
+            #endif
+            plan.solver = Solver::SPARSE;
         }
-        std::cout << std::endl;
+        else
+            plan.in_place = false;
+    }
+
+    /* Both rankings come out of one fused pass of Jacobi steps over the sparse storage */
+    if(plan.cheirank)
+    {
+        plan.solver   = Solver::SPARSE;
+        plan.in_place = false;
+        plan.reduce   = false;
+    }
+
+    /* The reduction is exact only when dangling scores follow the teleport vector too */
+    bool reduced = plan.reduce && can_lump(plan) && (plan.solver == Solver::SPARSE || plan.solver == Solver::LUMPED);
+    #ifdef DEBUG
+        if(plan.reduce && !reduced)
+            std::cout << "Reduction needs the sparse solver and a lumpable dangling policy, solving unreduced." << std::endl;
     #endif
-    return google_matrix;
-}
 
-double Graph::compute_difference(const std::vector<double>& r_old,
-                                 const std::vector<double>& r_new)
-{
-    double sum = 0.0;
-    for(size_t i = 0; i < this->num_nodes; i++)
+    PageRankResult result;
+    if(plan.cheirank)
+        result = solve_cheirank(plan);
+    else if(reduced)
+        result = solve_reduced(plan);
+    else switch(plan.solver)
     {
-        sum += std::abs(r_old[i] - r_new[i]);
+        case Solver::SPARSE: result = solve_sparse(plan); break;
+        case Solver::SMALL:  result = solve_small(plan);  break;
+        case Solver::LUMPED: result = solve_lumped(plan); break;
+        case Solver::AGGREGATION: result = solve_aggregation(plan); break;
+        case Solver::BITSET: result = solve_bitset(plan); break;
+        default:             result = solve_dense(plan);  break;
     }
-    return sum;
+
+    result.solver   = plan.solver;
+    result.in_place = plan.in_place && plan.solver != Solver::SMALL;
+    return result;
 }
 
-struct PageRankResult Graph::compute_pagerank()
+struct PageRankResult Graph::solve_dense(const PageRankOptions& options)
 {
-    /* Return values */
-    std::vector<double> pagerank_matrix;
-    std::vector<double> convergence_history;
-    convergence_history.reserve(this->MAX_ITER);
-
-    auto google_matrix = build_google_matrix();
-    std::vector<double> r_old = std::vector<double>(this->num_nodes, static_cast<double>(1.0/this->num_nodes));  
-    std::vector<double> r_new(this->num_nodes, 0.0);
+    ConvergenceTracker tracker(options.check_every, this->EPSILON, this->MAX_ITER, options.top_k_criterion());
+    size_t iterations = 0;
+
+    /* Sweeps run in row order, steps split the rows in whole blocks */
+    size_t threads = 1;
+    if(!options.in_place)
+        threads = options.num_threads != 0 ? options.num_threads
+                                           : threads_for(this->num_nodes * this->num_nodes, DENSE_ENTRIES_PER_THREAD);
+    const size_t blocks = (this->num_nodes + DENSE_BLOCK_ROWS - 1) / DENSE_BLOCK_ROWS;
+    std::vector<size_t> splits = even_splits(blocks, threads);
+    for(size_t& split : splits)
+        split = std::min(split * DENSE_BLOCK_ROWS, this->num_nodes);
+
+    DenseMatrix google_matrix = build_google_matrix(options, threads);
+
+    /* Double buffer: r_old always holds the newest iterate once a step has been swapped in */
+    pr_vector<double> r_old(this->num_nodes, static_cast<double>(1.0/this->num_nodes));  
+    pr_vector<double> r_new;
+    if(!options.in_place)
+        r_new.resize(this->num_nodes, 0.0);
     
     for(size_t i = 0; i < this->MAX_ITER; i++)
     {
-        for(size_t row = 0; row < this->num_nodes; row++)
-        {
-            r_new[row] = 0.0;
-            for(size_t col = 0; col < this->num_nodes; col++)
-            {
-               r_new[row] += google_matrix[row][col] * r_old[col];
-            }
-        }
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            if(options.in_place)
+                return dense_sweep<S>(google_matrix, options.norm, measure, r_old);
+
+            double d = dense_step<S>(google_matrix, splits, options.norm, measure, r_old, r_new);
+            r_old.swap(r_new);
 
-        double diff = compute_difference(r_old, r_new); 
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old.data(), r_old.size());
+            return d;
+        });
+        iterations++;
 
-        if(diff < this->EPSILON)
+        if(measure && tracker.converged(diff, r_old.data(), r_old.size()))
         {
-            convergence_history.push_back(diff);
             #ifdef DEBUG
                 std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
             #endif
             break;
         } 
-
-        convergence_history.push_back(diff);
-        r_old = r_new;
     }
     
     #ifdef DEBUG
-        /* Create index-to-label mapping */
-        std::vector<std::string> labels(num_nodes);
-        for(const auto& pair : node_to_index)
-        {
-            labels[pair.second] = pair.first;
-        }
+        /* Labels for printing */
+        const std::vector<std::string>& labels = this->index_to_node;
         
         /* Print final PageRank vector */
         std::cout << "=== Final PageRank Vector ===" << std::endl;
         std::cout << std::fixed << std::setprecision(6);
         for(size_t i = 0; i < this->num_nodes; i++)
         {
-            std::cout << labels[i] << " [ " << r_new[i] << " ]" << std::endl;
+            std::cout << labels[i] << " [ " << r_old[i] << " ]" << std::endl;
         }
         std::cout << std::endl;
     #endif
 
-    return PageRankResult{r_new, convergence_history, convergence_history.size()};
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    result.num_threads = splits.size() - 1;
+    return result;
 }
@@ -0,0 +1,97 @@
+#include "graph.h"
+#include <string>
+#ifdef DEBUG 
+    #include <iostream>
+#endif
+
+/* Bytes a string keeps on the heap, nothing while it fits its inline buffer */
+static size_t string_bytes(const std::string& s)
+{
+    const char* object = reinterpret_cast<const char*>(&s);
+    bool inline_buffer = s.data() >= object && s.data() < object + sizeof(std::string);
+    return inline_buffer ? 0 : s.capacity() + 1;
+}
+
+static size_t csr_bytes(const CSR& csr)
+{
+    return buffer_bytes(csr.offsets) + buffer_bytes(csr.indices) + buffer_bytes(csr.weights);
+}
+
+MemoryUsage Graph::memory_usage() const
+{
+    MemoryUsage usage;
+
+    usage.structure = buffer_bytes(this->edge_src) + buffer_bytes(this->edge_dest) + buffer_bytes(this->edge_weight)
+                    + csr_bytes(this->in_links) + buffer_bytes(this->out_degrees) + buffer_bytes(this->inv_out_degrees);
+
+    usage.labels = buffer_bytes(this->index_to_node);
+    for(const std::string& label : this->index_to_node)
+        usage.labels += string_bytes(label);
+
+    usage.index = this->label_index.memory_bytes();
+
+    usage.caches = buffer_bytes(this->stats.in_degree_histogram) + buffer_bytes(this->stats.out_degree_histogram)
+                 + buffer_bytes(this->stats.dangling_nodes) + buffer_bytes(this->adj_bits.words)
+                 + buffer_bytes(this->reduction.roles) + buffer_bytes(this->reduction.upstream_order)
+                 + buffer_bytes(this->reduction.downstream_order) + buffer_bytes(this->reduction.substitutions)
+                 + buffer_bytes(this->reduction.core) + csr_bytes(this->reduction.core_in_links)
+                 + buffer_bytes(this->reduction.core_column_sums);
+
+    return usage;
+}
+
+/*
+ * Peak bytes of a graph with the given shape once its sparse storage is built
+ * and solved, without allocating anything:
+ *
+ *  - per node: label slot, hash index slots, degrees, CSR offset, and the five
+ *    n-length solver buffers (two score vectors, pre-scaled scores, teleport
+ *    vector, dangling flags);
+ *  - per edge: the source and destination lists plus the CSR build, which
+ *    holds the scattered copy and the final indices at once (and the same
+ *    again for weights).
+ *
+ * `label_bytes` is the total length of the labels; short labels fit inline.
+ */
+size_t Graph::estimate_memory(size_t num_nodes, size_t num_edges, size_t label_bytes, bool weighted)
+{
+    size_t per_node = sizeof(std::string)
+                    + sizeof(int) + sizeof(double) + sizeof(size_t)
+                    + 5 * sizeof(double);
+
+    size_t per_edge = 2 * sizeof(int) + 2 * sizeof(int);
+    if(weighted)
+        per_edge += sizeof(double) + 2 * sizeof(double);
+
+    return num_nodes * per_node + LabelIndex::estimate_bytes(num_nodes) + num_edges * per_edge + label_bytes;
+}
+
+/* The dense solver builds the Google matrix alone, one contiguous buffer of padded rows */
+size_t Graph::dense_memory(size_t num_nodes)
+{
+    return DenseMatrix::bytes_for(num_nodes, num_nodes);
+}
+
+void Graph::reserve(size_t num_nodes, size_t num_edges, size_t label_bytes, bool weighted)
+{
+    /* Rejected before anything is allocated */
+    size_t estimate = estimate_memory(num_nodes, num_edges, label_bytes, weighted);
+    if(this->memory_budget != 0 && estimate > this->memory_budget)
+    {
+        throw std::length_error("graph of " + std::to_string(num_nodes) + " nodes and " +
+                                std::to_string(num_edges) + " edges needs about " + std::to_string(estimate) +
+                                " bytes, over the budget of " + std::to_string(this->memory_budget));
+    }
+
+    this->index_to_node.reserve(num_nodes);
+    this->label_index.reserve(num_nodes);
+    this->edge_src.reserve(num_edges);
+    this->edge_dest.reserve(num_edges);
+    if(weighted)
+        this->edge_weight.reserve(num_edges);
+
+    #ifdef DEBUG
+        std::cout << "Reserved " << num_nodes << " nodes and " << num_edges << " edges, about "
+                  << estimate << " bytes." << std::endl;
+    #endif
+}
@@ -0,0 +1,194 @@
+#include "graph_stats.h"
+#include "parallel.h"
+#include <algorithm>
+#include <vector>
+
+/* What one thread accumulates over its range of nodes */
+struct PartialStats {
+    size_t num_sources = 0;
+    size_t num_self_loops = 0;
+    size_t max_in_degree = 0;
+    size_t max_out_degree = 0;
+    std::vector<size_t> in_histogram;
+    std::vector<size_t> out_histogram;
+    std::vector<int> dangling_nodes;
+};
+
+static void bump(std::vector<size_t>& histogram, size_t degree)
+{
+    if(degree >= histogram.size())
+        histogram.resize(degree + 1, 0);
+    histogram[degree]++;
+}
+
+static void merge_histogram(std::vector<size_t>& into, const std::vector<size_t>& from)
+{
+    if(from.size() > into.size())
+        into.resize(from.size(), 0);
+    for(size_t d = 0; d < from.size(); d++)
+        into[d] += from[d];
+}
+
+/*
+ * Iterative Tarjan over the in-link rows. The transposed graph has the same
+ * strongly connected components, so the in-links are all that is needed.
+ */
+static void strongly_connected_components(const CSR& in_links, size_t& num_sccs, size_t& largest_scc)
+{
+    const size_t n = in_links.num_rows();
+    const int UNVISITED = -1;
+
+    std::vector<int> index(n, UNVISITED);
+    std::vector<int> low(n, 0);
+    std::vector<char> on_stack(n, 0);
+    std::vector<int> stack;
+    std::vector<std::pair<int, size_t>> call_stack;   /* (node, next edge) */
+    int next_index = 0;
+
+    num_sccs = 0;
+    largest_scc = 0;
+
+    for(size_t root = 0; root < n; root++)
+    {
+        if(index[root] != UNVISITED)
+            continue;
+
+        call_stack.push_back({static_cast<int>(root), in_links.offsets[root]});
+        index[root] = low[root] = next_index++;
+        stack.push_back(static_cast<int>(root));
+        on_stack[root] = 1;
+
+        while(!call_stack.empty())
+        {
+            int v = call_stack.back().first;
+            size_t& e = call_stack.back().second;
+
+            if(e < in_links.offsets[v + 1])
+            {
+                int w = in_links.indices[e++];
+                if(index[w] == UNVISITED)
+                {
+                    index[w] = low[w] = next_index++;
+                    stack.push_back(w);
+                    on_stack[w] = 1;
+                    call_stack.push_back({w, in_links.offsets[w]});
+                }
+                else if(on_stack[w])
+                {
+                    low[v] = std::min(low[v], index[w]);
+                }
+                continue;
+            }
+
+            /* All edges of v done: pop a component if v is its root */
+            if(low[v] == index[v])
+            {
+                size_t size = 0;
+                int w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = 0;
+                    size++;
+                } while(w != v);
+
+                num_sccs++;
+                largest_scc = std::max(largest_scc, size);
+            }
+
+            call_stack.pop_back();
+            if(!call_stack.empty())
+            {
+                int parent = call_stack.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+        }
+    }
+}
+
+GraphStats compute_graph_stats(const CSR& in_links, const pr_vector<int>& out_degrees, size_t num_threads)
+{
+    GraphStats stats;
+    const size_t n = in_links.num_rows();
+    stats.num_nodes = n;
+    stats.num_edges = in_links.num_entries();
+
+    num_threads = std::max<size_t>(1, std::min(num_threads, n));
+    std::vector<PartialStats> partials(num_threads);
+
+    parallel_for(n, num_threads, [&](size_t t, size_t begin, size_t end) {
+        PartialStats& local = partials[t];
+
+        for(size_t v = begin; v < end; v++)
+        {
+            size_t in_degree  = in_links.degree(v);
+            size_t out_degree = static_cast<size_t>(out_degrees[v]);
+
+            bump(local.in_histogram, in_degree);
+            bump(local.out_histogram, out_degree);
+            local.max_in_degree  = std::max(local.max_in_degree, in_degree);
+            local.max_out_degree = std::max(local.max_out_degree, out_degree);
+
+            if(in_degree == 0)
+                local.num_sources++;
+            if(out_degree == 0)
+                local.dangling_nodes.push_back(static_cast<int>(v));
+
+            /* Rows are sorted, so a self-loop is found by one search */
+            const int* row_begin = in_links.indices.data() + in_links.offsets[v];
+            const int* row_end   = in_links.indices.data() + in_links.offsets[v + 1];
+            if(std::binary_search(row_begin, row_end, static_cast<int>(v)))
+                local.num_self_loops++;
+        }
+    });
+
+    for(const PartialStats& local : partials)
+    {
+        stats.num_sources    += local.num_sources;
+        stats.num_self_loops += local.num_self_loops;
+        stats.max_in_degree  = std::max(stats.max_in_degree, local.max_in_degree);
+        stats.max_out_degree = std::max(stats.max_out_degree, local.max_out_degree);
+        merge_histogram(stats.in_degree_histogram, local.in_histogram);
+        merge_histogram(stats.out_degree_histogram, local.out_histogram);
+        stats.dangling_nodes.insert(stats.dangling_nodes.end(), local.dangling_nodes.begin(), local.dangling_nodes.end());
+    }
+
+    stats.num_dangling = stats.dangling_nodes.size();
+    return stats;
+}
+
+void compute_structure_stats(const CSR& in_links, GraphStats& stats, size_t num_threads)
+{
+    const size_t n = in_links.num_rows();
+    num_threads = std::max<size_t>(1, std::min(num_threads, n));
+    std::vector<size_t> reciprocated(num_threads, 0);
+
+    parallel_for(n, num_threads, [&](size_t t, size_t begin, size_t end) {
+        size_t count = 0;
+        for(size_t v = begin; v < end; v++)
+        {
+            /* Edge u -> v is reciprocated when v appears among the sources of u */
+            for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+            {
+                int u = in_links.indices[e];
+                if(static_cast<size_t>(u) == v)
+                    continue;
+
+                const int* row_begin = in_links.indices.data() + in_links.offsets[u];
+                const int* row_end   = in_links.indices.data() + in_links.offsets[u + 1];
+                if(std::binary_search(row_begin, row_end, static_cast<int>(v)))
+                    count++;
+            }
+        }
+        reciprocated[t] = count;
+    });
+
+    size_t total = 0;
+    for(size_t count : reciprocated)
+        total += count;
+    size_t non_loop_edges = stats.num_edges - stats.num_self_loops;
+    stats.reciprocity = non_loop_edges == 0 ? 0.0 : static_cast<double>(total) / non_loop_edges;
+
+    strongly_connected_components(in_links, stats.num_sccs, stats.largest_scc);
+}
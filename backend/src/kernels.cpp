@@ -0,0 +1,66 @@
+#include "kernels.h"
+#include "convergence.h"
+#include "csr.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+
+/*
+ * Rows [begin, end) of a gather step, with prefetching fixed for the whole
+ * range. Personalization, self-loops and measuring are per-node branches
+ * that go the same way for every node of a step.
+ */
+template <typename Features, bool InPlace, Summation S, bool Prefetch>
+static Residual<S> gather_rows(const GatherArgs<typename Features::Scalar>& args, size_t begin, size_t end, bool measure)
+{
+    using Scalar = typename Features::Scalar;
+
+    Residual<S> residual;
+    const size_t* offsets   = args.in_links->offsets.data();
+    const int* sources      = args.in_links->indices.data();
+    const double* weights   = args.in_links->weights.data();
+    const size_t last_edge  = args.in_links->num_entries() ? args.in_links->num_entries() - 1 : 0;
+    Scalar* scaled          = args.scaled;
+
+    for(size_t v = begin; v < end; v++)
+    {
+        Accumulator<S> sum;
+        for(size_t e = offsets[v]; e < offsets[v + 1]; e++)
+        {
+            if constexpr (Prefetch)
+                PR_PREFETCH(scaled + sources[std::min(e + args.distance, last_edge)]);
+
+            if constexpr (Features::Weighted)
+                sum.add(weights[e] * static_cast<double>(scaled[sources[e]]));
+            else
+                sum.add(static_cast<double>(scaled[sources[e]]));
+        }
+
+        double old     = static_cast<double>(args.r_old[v]);
+        double updated = args.alpha * sum.value() + args.base;
+
+        if(args.teleport != nullptr)
+            updated += args.teleport_scale * args.teleport[v];
+
+        if(args.dangling != nullptr)
+            updated += args.alpha * old * args.dangling[v];
+
+        args.r_new[v] = static_cast<Scalar>(updated);
+
+        if constexpr (InPlace)
+            scaled[v] = static_cast<Scalar>(updated * args.inv_out_degrees[v]);
+
+        if(measure)
+            residual.add(old, updated);
+    }
+    return residual;
+}
+
+template <typename Features, bool InPlace, Summation S>
+Residual<S> gather_step(const GatherArgs<typename Features::Scalar>& args, size_t begin, size_t end, bool measure)
+{
+    return args.prefetch ? gather_rows<Features, InPlace, S, true>(args, begin, end, measure)
+                         : gather_rows<Features, InPlace, S, false>(args, begin, end, measure);
+}
+
+PR_GATHER_STEPS()
@@ -0,0 +1,149 @@
+#include "label_index.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cstring>
+
+/* Lookups walked through the prefetch stages together */
+static constexpr size_t FIND_GROUP = 16;
+
+static inline uint64_t rotate_left(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+/* Final avalanche so every input bit reaches the low bits the table masks with */
+static inline uint64_t finalize_hash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Eight bytes per step, the ragged tail zero-padded into one more word */
+uint64_t LabelIndex::hash(std::string_view label)
+{
+    const uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+    const char* data = label.data();
+    size_t length = label.size();
+    uint64_t h = length * MULTIPLIER;
+
+    while(length >= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        h = rotate_left(h ^ (word * MULTIPLIER), 31) * MULTIPLIER;
+        data += 8;
+        length -= 8;
+    }
+    if(length != 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, data, length);
+        h = rotate_left(h ^ (word * MULTIPLIER), 31) * MULTIPLIER;
+    }
+    return finalize_hash(h);
+}
+
+int LabelIndex::find(std::string_view label, uint64_t h, const std::vector<std::string>& labels) const
+{
+    if(slots.empty())
+        return -1;
+
+    size_t mask = slots.size() - 1;
+    for(size_t i = h & mask; ; i = (i + 1) & mask)
+    {
+        const Slot& slot = slots[i];
+        if(slot.index == EMPTY)
+            return -1;
+        if(slot.hash == h && labels[slot.index] == label)
+            return slot.index;
+    }
+}
+
+void LabelIndex::find_batch(const std::string_view* batch, size_t count, int64_t* indices,
+                            const std::vector<std::string>& labels) const
+{
+    if(slots.empty())
+    {
+        std::fill(indices, indices + count, int64_t{-1});
+        return;
+    }
+
+    const size_t mask = slots.size() - 1;
+    uint64_t hashes[FIND_GROUP];
+    int first[FIND_GROUP];
+
+    for(size_t base = 0; base < count; base += FIND_GROUP)
+    {
+        size_t group = std::min(FIND_GROUP, count - base);
+
+        /* Stage 1: hash and request the home slot */
+        for(size_t k = 0; k < group; k++)
+        {
+            hashes[k] = hash(batch[base + k]);
+            PR_PREFETCH(&slots[hashes[k] & mask]);
+        }
+
+        /* Stage 2: request the label object of the first candidate */
+        for(size_t k = 0; k < group; k++)
+        {
+            const Slot& slot = slots[hashes[k] & mask];
+            first[k] = (slot.index != EMPTY && slot.hash == hashes[k]) ? slot.index : EMPTY;
+            if(first[k] != EMPTY)
+                PR_PREFETCH(&labels[first[k]]);
+        }
+
+        /* Stage 3: request its bytes */
+        for(size_t k = 0; k < group; k++)
+            if(first[k] != EMPTY)
+                PR_PREFETCH(labels[first[k]].data());
+
+        /* Stage 4: the real probe, now mostly hitting the cache */
+        for(size_t k = 0; k < group; k++)
+            indices[base + k] = find(batch[base + k], hashes[k], labels);
+    }
+}
+
+void LabelIndex::insert(uint64_t h, int index)
+{
+    if(2 * (count + 1) > slots.size())
+        rehash(slots.empty() ? 16 : 2 * slots.size());
+
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while(slots[i].index != EMPTY)
+        i = (i + 1) & mask;
+
+    slots[i] = Slot{h, index};
+    count++;
+}
+
+void LabelIndex::reserve(size_t num_labels)
+{
+    size_t capacity = slots.empty() ? 16 : slots.size();
+    while(capacity < 2 * num_labels)
+        capacity *= 2;
+    if(capacity != slots.size())
+        rehash(capacity);
+}
+
+void LabelIndex::rehash(size_t capacity)
+{
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(capacity, Slot{0, EMPTY});
+
+    size_t mask = capacity - 1;
+    for(const Slot& slot : old)
+    {
+        if(slot.index == EMPTY)
+            continue;
+        size_t i = slot.hash & mask;
+        while(slots[i].index != EMPTY)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
@@ -0,0 +1,295 @@
+#include "graph.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/*
+ * The non-dangling part of the graph, renumbered to 0 .. k-1 in node order.
+ * Every edge leaves a non-dangling node, so the in-links of the kept rows
+ * only ever name kept sources and the rows need no filtering, only renumbering.
+ */
+struct LumpedSystem {
+    CSR in_links;                       /* In-links of the non-dangling nodes, renumbered */
+    pr_vector<double> inv_out_degrees;
+    pr_vector<double> teleport;         /* Teleport weight of every non-dangling node */
+    std::vector<int> nodes;             /* Node of the graph behind every row */
+    std::vector<size_t> row_splits;
+
+    /* Only filled when the iteration renormalizes */
+    pr_vector<double> dangling_shares;  /* Share of every row's score that its out-links pass to D */
+    double dangling_teleport = 0.0;     /* Teleport weight of D, |v_D|_1 */
+};
+
+/*
+ * Rescales r_N the way the final normalization would: by the total of r_N
+ * and of the dangling scores gathered from it,
+ *
+ *     |r_D|_1 = alpha * sum_u r_u * share_u + (1 - alpha * |r_N|_1) * |v_D|_1
+ */
+template <Summation S, typename Scalar>
+static void renormalize_lumped(const LumpedSystem& system, double alpha, Scalar* r, size_t k)
+{
+    Accumulator<S> mass, passed;
+    for(size_t row = 0; row < k; row++)
+    {
+        mass.add(static_cast<double>(r[row]));
+        passed.add(static_cast<double>(r[row]) * system.dangling_shares[row]);
+    }
+
+    double total = mass.value() + alpha * passed.value() + (1.0 - alpha * mass.value()) * system.dangling_teleport;
+    if(total <= 0.0)
+        return;
+
+    Scalar scale = static_cast<Scalar>(1.0 / total);
+    for(size_t row = 0; row < k; row++)
+        r[row] *= scale;
+}
+
+/*
+ * Power iteration restricted to the non-dangling nodes N. Whatever is not on N
+ * sits on the dangling nodes D and goes back out along the teleport vector v:
+ *
+ *     r_N <- alpha * H_NN^T r_N + (1 - alpha * |r_N|_1) * v_N
+ *
+ * where H is the transition matrix with the dangling rows left at zero. This
+ * is the ordinary power iteration with D lumped into a single state, so the
+ * iterates on N and the convergence rate are unchanged; only the rows of D
+ * and the edges into them drop out of every iteration. The residual is
+ * measured on N, whose change drives that of D.
+ */
+template <typename Features>
+static size_t lumped_iteration(const LumpedSystem& system, const PageRankOptions& options, double alpha,
+                               size_t num_nodes, ConvergenceTracker& tracker, size_t max_iter, bool prefetch,
+                               pr_vector<typename Features::Scalar>& r)
+{
+    using Scalar = typename Features::Scalar;
+
+    const size_t k = system.nodes.size();
+    pr_vector<Scalar> r_new;
+    if(!options.in_place)
+        r_new.resize(k, Scalar(0));
+    pr_vector<Scalar> scaled(k);
+
+    GatherArgs<Scalar> args;
+    args.in_links        = &system.in_links;
+    args.scaled          = scaled.data();
+    args.inv_out_degrees = system.inv_out_degrees.data();
+    args.teleport        = options.personalization.empty() ? nullptr : system.teleport.data();
+    args.dangling        = nullptr;
+    args.alpha           = alpha;
+    args.distance        = std::max<size_t>(options.prefetch_distance, 1);
+    args.prefetch        = prefetch;
+
+    size_t iterations = 0;
+    for(size_t i = 0; i < max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            /* Pre-scale the scores and total them, which leaves the mass on D */
+            const std::vector<size_t>& splits = system.row_splits;
+            std::vector<double> partial_mass(splits.size() - 1);
+            parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+                prescale(r.data() + begin, system.inv_out_degrees.data() + begin, scaled.data() + begin, end - begin);
+                partial_mass[t] = sum<S>(r.data() + begin, end - begin);
+            });
+            Accumulator<S> mass;
+            for(double part : partial_mass)
+                mass.add(part);
+
+            double teleport_mass = 1.0 - alpha * mass.value();
+            if(args.teleport != nullptr)
+            {
+                args.teleport_scale = teleport_mass;
+                args.base           = 0.0;
+            }
+            else
+            {
+                args.teleport_scale = 0.0;
+                args.base           = teleport_mass / static_cast<double>(num_nodes);
+            }
+
+            args.r_old = r.data();
+            args.r_new = options.in_place ? r.data() : r_new.data();
+
+            std::vector<Residual<S>> partial(splits.size() - 1);
+            parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+                partial[t] = options.in_place ? gather_step<Features, true, S>(args, begin, end, measure)
+                                              : gather_step<Features, false, S>(args, begin, end, measure);
+            });
+
+            Residual<S> residual;
+            for(const Residual<S>& part : partial)
+                residual.merge(part);
+
+            if(!options.in_place)
+                r.swap(r_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize_lumped<S>(system, alpha, r.data(), k);
+            return residual.value(options.norm);
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+    return iterations;
+}
+
+/*
+ * Ipsen-Selee lumping: when dangling nodes hand their score to the teleport
+ * vector, they all behave alike and can be iterated as one state. The scores
+ * on N converge on their own, then the dangling ones follow in one gather:
+ *
+ *     r_D = alpha * H_ND^T r_N + (1 - alpha * |r_N|_1) * v_D
+ *
+ * and the whole vector is normalized, as it is every renormalize_every
+ * iterations on the way. Every iteration skips the
+ * dangling rows and the edges into them, which on crawled graphs are a large
+ * share of both. Personalized Gauss-Seidel sweeps diverge under lumping;
+ * compute_pagerank sends them to the sparse solver.
+ */
+struct PageRankResult Graph::solve_lumped(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    if(n == 0)
+        return PageRankResult{{}, {}, 0};
+
+    build_sparse();
+
+    pr_vector<double> teleport = build_teleport_vector(options);
+    const bool personalized = !options.personalization.empty();
+
+    /* Renumber the non-dangling nodes, then copy their rows over in parallel */
+    LumpedSystem system;
+    std::vector<int> renumbered(n, -1);
+    system.nodes.reserve(n - this->stats.num_dangling);
+    for(size_t v = 0; v < n; v++)
+    {
+        if(this->out_degrees[v] == 0)
+            continue;
+        renumbered[v] = static_cast<int>(system.nodes.size());
+        system.nodes.push_back(static_cast<int>(v));
+    }
+    const size_t k = system.nodes.size();
+
+    system.in_links.offsets.resize(k + 1);
+    system.in_links.offsets[0] = 0;
+    for(size_t row = 0; row < k; row++)
+        system.in_links.offsets[row + 1] = system.in_links.offsets[row] + this->in_links.degree(system.nodes[row]);
+
+    const size_t m = system.in_links.offsets[k];
+    const bool weighted = this->in_links.is_weighted();
+    system.in_links.indices.resize(m);
+    if(weighted)
+        system.in_links.weights.resize(m);
+    system.inv_out_degrees.resize(k);
+    system.teleport.resize(personalized ? k : 0);
+
+    size_t threads = 1;
+    if(!options.in_place)
+        threads = options.num_threads != 0 ? options.num_threads : threads_for(k + m, SPARSE_WORK_PER_THREAD);
+    std::vector<size_t> copy_splits = even_splits(k, threads_for(k + m, SPARSE_WORK_PER_THREAD));
+
+    parallel_ranges(copy_splits, [&](size_t, size_t begin, size_t end) {
+        for(size_t row = begin; row < end; row++)
+        {
+            int v = system.nodes[row];
+            size_t position = system.in_links.offsets[row];
+            for(size_t e = this->in_links.offsets[v]; e < this->in_links.offsets[v + 1]; e++, position++)
+            {
+                system.in_links.indices[position] = renumbered[this->in_links.indices[e]];
+                if(weighted)
+                    system.in_links.weights[position] = this->in_links.weights[e];
+            }
+            system.inv_out_degrees[row] = this->inv_out_degrees[v];
+            if(personalized)
+                system.teleport[row] = teleport[v];
+        }
+    });
+    system.row_splits = balanced_row_splits(system.in_links, threads);
+
+    /* What the rows pass to D, for renormalizing the whole vector while only r_N is iterated */
+    if(options.renormalize_every != 0)
+    {
+        system.dangling_shares.assign(k, 0.0);
+        for(int v : this->stats.dangling_nodes)
+        {
+            for(size_t e = this->in_links.offsets[v]; e < this->in_links.offsets[v + 1]; e++)
+            {
+                int u = this->in_links.indices[e];
+                system.dangling_shares[renumbered[u]] += (weighted ? this->in_links.weights[e] : 1.0) * this->inv_out_degrees[u];
+            }
+            system.dangling_teleport += personalized ? teleport[v] : 1.0 / static_cast<double>(n);
+        }
+    }
+
+    size_t scalar_size = (options.precision == Precision::FLOAT) ? sizeof(float) : sizeof(double);
+    bool prefetch = (options.prefetch == Prefetch::ON) ||
+                    (options.prefetch == Prefetch::AUTO && k * scalar_size > last_level_cache_size());
+
+    #ifdef DEBUG
+        std::cout << "Lumped solver: " << k << " of " << n << " nodes, " << m << " of "
+                  << this->in_links.num_entries() << " edges, prefetch " << (prefetch ? "on" : "off") << ", "
+                  << system.row_splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    ConvergenceTracker tracker(options.check_every, this->EPSILON, this->MAX_ITER);
+    const double alpha = this->ALPHA;
+
+    /* Iterate r_N, then gather r_D from it and normalize, all in double */
+    pr_vector<double> r(n, 0.0);
+    size_t iterations = branch(options.precision == Precision::FLOAT, [&](auto f) {
+        return branch(weighted, [&](auto w) {
+            using Scalar   = std::conditional_t<decltype(f)::value, float, double>;
+            using Features = KernelFeatures<Scalar, decltype(w)::value>;
+
+            pr_vector<Scalar> r_lumped(k, static_cast<Scalar>(1.0 / static_cast<double>(n)));
+            size_t done = lumped_iteration<Features>(system, options, alpha, n, tracker, this->MAX_ITER,
+                                                     prefetch, r_lumped);
+            for(size_t row = 0; row < k; row++)
+                r[system.nodes[row]] = static_cast<double>(r_lumped[row]);
+            return done;
+        });
+    });
+
+    pr_vector<double> scaled(n);
+    prescale(r.data(), this->inv_out_degrees.data(), scaled.data(), n);
+
+    dispatch_summation(options.summation, [&](auto summation) {
+        constexpr Summation S = decltype(summation)::value;
+
+        double teleport_mass = 1.0 - alpha * sum<S>(r.data(), n);
+        for(int v : this->stats.dangling_nodes)
+        {
+            Accumulator<S> sum;
+            for(size_t e = this->in_links.offsets[v]; e < this->in_links.offsets[v + 1]; e++)
+                sum.add(weighted ? this->in_links.weights[e] * scaled[this->in_links.indices[e]]
+                                 : scaled[this->in_links.indices[e]]);
+            r[v] = alpha * sum.value() + teleport_mass * (personalized ? teleport[v] : 1.0 / static_cast<double>(n));
+        }
+        renormalize<S>(r.data(), n);
+        return 0.0;
+    });
+
+    PageRankResult result{std::vector<double>(r.begin(), r.end()), tracker.get_history(), iterations};
+    result.num_threads = system.row_splits.size() - 1;
+    result.termination = tracker.get_reason();
+    return result;
+}
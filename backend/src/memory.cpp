@@ -0,0 +1,197 @@
+#include "memory.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+#ifdef DEBUG 
+    #include <iostream>
+#endif
+
+static std::atomic<HugePageMode> huge_page_mode{HugePageMode::OFF};
+static std::atomic<size_t> current_bytes{0};
+static std::atomic<size_t> peak_bytes{0};
+
+/* How a block of allocate_pages() was obtained, looked up when it is released */
+struct LargeBlock {
+    size_t length;      /* Bytes mapped or allocated, as recorded */
+    bool mapped;        /* mmap under TRANSPARENT / EXPLICIT, operator new under OFF */
+};
+static std::mutex large_blocks_mutex;
+
+/* Never destroyed, so buffers released during static destruction still find their block */
+static std::unordered_map<void*, LargeBlock>& large_blocks()
+{
+    static auto* blocks = new std::unordered_map<void*, LargeBlock>();
+    return *blocks;
+}
+
+void set_huge_page_mode(HugePageMode mode)
+{
+    huge_page_mode.store(mode, std::memory_order_relaxed);
+}
+
+HugePageMode get_huge_page_mode()
+{
+    return huge_page_mode.load(std::memory_order_relaxed);
+}
+
+size_t last_level_cache_size()
+{
+    static const size_t cache_size = []() -> size_t {
+        long bytes = -1;
+        #if defined(_SC_LEVEL3_CACHE_SIZE)
+            bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        #endif
+        #if defined(_SC_LEVEL2_CACHE_SIZE)
+            if(bytes <= 0)
+                bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        #endif
+
+        /* Unknown, assume a typical 8 MB shared cache */
+        return (bytes > 0) ? static_cast<size_t>(bytes) : (size_t{8} << 20);
+    }();
+    return cache_size;
+}
+
+static size_t round_to_huge_page(size_t bytes)
+{
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+size_t allocation_size(size_t bytes)
+{
+#ifdef __linux__
+    bool mapped = bytes >= HUGE_PAGE_SIZE && get_huge_page_mode() != HugePageMode::OFF;
+    return mapped ? round_to_huge_page(bytes) : bytes;
+#else
+    return bytes;
+#endif
+}
+
+size_t allocated_bytes()
+{
+    return current_bytes.load(std::memory_order_relaxed);
+}
+
+size_t peak_allocated_bytes()
+{
+    return peak_bytes.load(std::memory_order_relaxed);
+}
+
+void reset_peak_allocated_bytes()
+{
+    peak_bytes.store(allocated_bytes(), std::memory_order_relaxed);
+}
+
+void record_allocation(size_t bytes) noexcept
+{
+    size_t now  = current_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while(now > peak && !peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+        ;
+}
+
+void record_deallocation(size_t bytes) noexcept
+{
+    current_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+static void* remember_block(void* ptr, size_t length, bool mapped)
+{
+    {
+        std::lock_guard<std::mutex> lock(large_blocks_mutex);
+        large_blocks()[ptr] = LargeBlock{length, mapped};
+    }
+    record_allocation(length);
+    return ptr;
+}
+
+/* Page-mapped block of whole huge pages, THP-advised unless MAP_HUGETLB succeeds; nullptr when mmap fails */
+static void* map_pages(size_t length, HugePageMode mode)
+{
+#ifdef __linux__
+    if(mode == HugePageMode::EXPLICIT)
+    {
+        void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(ptr != MAP_FAILED)
+            return ptr;
+
+        /* The reserved huge page pool is empty or not configured */
+        #ifdef DEBUG 
+            std::cout << "MAP_HUGETLB failed for " << length << " bytes, falling back to THP." << std::endl;
+        #endif
+    }
+
+    /* Over-map by one huge page, then trim the mapping to a 2 MB boundary so THP can back it */
+    size_t padded = length + HUGE_PAGE_SIZE;
+    void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+        return nullptr;
+
+    uintptr_t start   = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t{HUGE_PAGE_SIZE} - 1);
+    size_t head = aligned - start;
+    size_t tail = padded - head - length;
+
+    if(head != 0)
+        munmap(raw, head);
+    if(tail != 0)
+        munmap(reinterpret_cast<void*>(aligned + length), tail);
+
+    madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+    return reinterpret_cast<void*>(aligned);
+#else
+    (void)length;
+    (void)mode;
+    return nullptr;
+#endif
+}
+
+void* allocate_pages(size_t bytes)
+{
+    HugePageMode mode = get_huge_page_mode();
+
+    /* OFF means the default allocator, with whatever the kernel does for it */
+#ifdef __linux__
+    if(mode != HugePageMode::OFF)
+    {
+        /* Every mapping covers whole huge pages */
+        size_t length = round_to_huge_page(bytes);
+        void* ptr = map_pages(length, mode);
+        if(ptr == nullptr)
+            throw std::bad_alloc();
+        return remember_block(ptr, length, true);
+    }
+#endif
+    return remember_block(::operator new(bytes), bytes, false);
+}
+
+void deallocate_pages(void* ptr, size_t bytes) noexcept
+{
+    LargeBlock block{bytes, false};
+    {
+        std::lock_guard<std::mutex> lock(large_blocks_mutex);
+        auto it = large_blocks().find(ptr);
+        if(it != large_blocks().end())
+        {
+            block = it->second;
+            large_blocks().erase(it);
+        }
+    }
+
+#ifdef __linux__
+    if(block.mapped)
+        munmap(ptr, block.length);
+    else
+        ::operator delete(ptr);
+#else
+    ::operator delete(ptr);
+#endif
+    record_deallocation(block.length);
+}
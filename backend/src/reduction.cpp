@@ -0,0 +1,528 @@
+#include "graph.h"
+#include "reduction.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/*
+ * The linear system of GraphReduction holds exactly when dangling nodes
+ * follow the teleport vector (b = v before any node is removed). Unlike the
+ * power iteration it has no global dangling term, so every node only depends
+ * on its in-neighbours and nodes can be removed one at a time without
+ * approximation. The scores are y / |y|_1.
+ */
+
+/* A term M[.][node] or M[node][.] of the core system */
+struct Entry {
+    int node;
+    double weight;
+};
+
+/* An entry added by an elimination, chained per node */
+struct AddedEntry {
+    Entry entry;
+    int next;
+};
+
+/*
+ * In- or out-entries of every core node: the ones taken from the graph in
+ * flat rows, plus the ones eliminations add, chained in a pool. Entries of
+ * eliminated nodes are left in place and skipped; `live` counts the others,
+ * self-loops excluded, which are kept apart in the diagonal.
+ */
+struct CoreLists {
+    pr_vector<size_t> offsets;
+    pr_vector<Entry> entries;
+    std::vector<int> head;
+    std::vector<AddedEntry> added;
+    std::vector<int> live;
+
+    void add(int node, Entry entry)
+    {
+        added.push_back(AddedEntry{entry, head[node]});
+        head[node] = static_cast<int>(added.size() - 1);
+        live[node]++;
+    }
+
+    /* Calls fn(entry) for every entry of `node`, dead ones included */
+    template <typename Fn>
+    void for_each(int node, Fn&& fn) const
+    {
+        for(size_t e = offsets[node]; e < offsets[node + 1]; e++)
+            fn(entries[e]);
+        for(int a = head[node]; a != -1; a = added[a].next)
+            fn(added[a].entry);
+    }
+};
+
+/* Out-links of every node, transposed from the in-links, with their M weights */
+static void transpose(const CSR& in_links, const pr_vector<double>& inv_out_degrees, double alpha,
+                      pr_vector<size_t>& offsets, pr_vector<int>& targets, pr_vector<double>& weights)
+{
+    const size_t n = in_links.num_rows();
+    offsets.assign(n + 1, 0);
+    for(size_t e = 0; e < in_links.num_entries(); e++)
+        offsets[in_links.indices[e] + 1]++;
+    for(size_t u = 0; u < n; u++)
+        offsets[u + 1] += offsets[u];
+
+    targets.resize(in_links.num_entries());
+    weights.resize(in_links.num_entries());
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for(size_t v = 0; v < n; v++)
+    {
+        for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+        {
+            int u = in_links.indices[e];
+            double w = in_links.is_weighted() ? in_links.weights[e] : 1.0;
+            size_t position = cursor[u]++;
+            targets[position] = static_cast<int>(v);
+            weights[position] = alpha * w * inv_out_degrees[u];
+        }
+    }
+}
+
+/*
+ * Peels the acyclic fringes (Kahn's algorithm from both ends), then
+ * eliminates core nodes with exactly one core in-neighbour u and one core
+ * out-neighbour w, self-loops aside. For such a node c
+ *
+ *     y_c = s * (M[c][u] y_u + b_c),      s = 1 / (1 - M[c][c])
+ *
+ * substituted into w's equation gives w a term s M[w][c] M[c][u] y_u (a
+ * self-loop when w = u) and adds s M[w][c] b_c to b_w. Chains shrink to one
+ * edge and pendant trees, whose links run both ways, fold into self-loops
+ * on the node they hang off.
+ */
+GraphReduction reduce_graph(const CSR& in_links, const pr_vector<double>& inv_out_degrees,
+                            const pr_vector<int>& out_degrees, double alpha)
+{
+    const size_t n = in_links.num_rows();
+    GraphReduction reduction;
+    reduction.roles.assign(n, NodeRole::CORE);
+
+    pr_vector<size_t> out_offsets;
+    pr_vector<int> out_targets;
+    pr_vector<double> out_weights;
+    transpose(in_links, inv_out_degrees, alpha, out_offsets, out_targets, out_weights);
+
+    /* Upstream: nodes whose in-neighbours are all upstream, fixed in this order */
+    std::vector<size_t> remaining(n);
+    std::vector<int> queue;
+    for(size_t v = 0; v < n; v++)
+    {
+        remaining[v] = in_links.degree(v);
+        if(remaining[v] == 0)
+            queue.push_back(static_cast<int>(v));
+    }
+    while(!queue.empty())
+    {
+        int u = queue.back();
+        queue.pop_back();
+        reduction.roles[u] = NodeRole::UPSTREAM;
+        reduction.upstream_order.push_back(u);
+        for(size_t e = out_offsets[u]; e < out_offsets[u + 1]; e++)
+            if(--remaining[out_targets[e]] == 0)
+                queue.push_back(out_targets[e]);
+    }
+
+    /* Downstream: non-upstream nodes whose out-neighbours are all downstream */
+    for(size_t v = 0; v < n; v++)
+    {
+        remaining[v] = static_cast<size_t>(out_degrees[v]);
+        if(remaining[v] == 0 && reduction.roles[v] == NodeRole::CORE)
+            queue.push_back(static_cast<int>(v));
+    }
+    while(!queue.empty())
+    {
+        int v = queue.back();
+        queue.pop_back();
+        reduction.roles[v] = NodeRole::DOWNSTREAM;
+        reduction.downstream_order.push_back(v);
+        for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+        {
+            int u = in_links.indices[e];
+            if(reduction.roles[u] == NodeRole::CORE && --remaining[u] == 0)
+                queue.push_back(u);
+        }
+    }
+
+    /* Core lists: in-entries from core sources, out-entries to core targets */
+    auto is_core = [&](int node) { return reduction.roles[node] == NodeRole::CORE; };
+    std::vector<double> diagonal(n, 0.0);
+    CoreLists in, out;
+    for(CoreLists* lists : {&in, &out})
+    {
+        lists->offsets.assign(n + 1, 0);
+        lists->head.assign(n, -1);
+        lists->live.assign(n, 0);
+    }
+    for(size_t u = 0; u < n; u++)
+    {
+        if(!is_core(static_cast<int>(u)))
+        {
+            in.offsets[u + 1] = in.offsets[u];
+            out.offsets[u + 1] = out.offsets[u];
+            continue;
+        }
+        out.offsets[u + 1] = out.offsets[u];
+        for(size_t e = out_offsets[u]; e < out_offsets[u + 1]; e++)
+        {
+            int w = out_targets[e];
+            if(!is_core(w))
+                continue;
+            if(w == static_cast<int>(u))
+            {
+                diagonal[u] = out_weights[e];
+                continue;
+            }
+            out.entries.push_back(Entry{w, out_weights[e]});
+            out.offsets[u + 1]++;
+            out.live[u]++;
+        }
+    }
+    /* In-entries are the same terms, regrouped by target */
+    in.entries.resize(out.entries.size());
+    for(size_t u = 0; u < n; u++)
+        for(size_t e = out.offsets[u]; e < out.offsets[u + 1]; e++)
+            in.offsets[out.entries[e].node + 1]++;
+    for(size_t v = 0; v < n; v++)
+        in.offsets[v + 1] += in.offsets[v];
+    {
+        std::vector<size_t> cursor(in.offsets.begin(), in.offsets.end() - 1);
+        for(size_t u = 0; u < n; u++)
+        {
+            for(size_t e = out.offsets[u]; e < out.offsets[u + 1]; e++)
+            {
+                int w = out.entries[e].node;
+                in.entries[cursor[w]++] = Entry{static_cast<int>(u), out.entries[e].weight};
+                in.live[w]++;
+            }
+        }
+    }
+
+    /* The one live entry of an eligible node, skipping eliminated neighbours */
+    auto live_entry = [&](const CoreLists& lists, int node) {
+        Entry found{-1, 0.0};
+        lists.for_each(node, [&](const Entry& entry) {
+            if(found.node == -1 && is_core(entry.node))
+                found = entry;
+        });
+        return found;
+    };
+
+    std::vector<int> candidates;
+    for(size_t v = n; v-- > 0;)
+        if(is_core(static_cast<int>(v)))
+            candidates.push_back(static_cast<int>(v));
+
+    while(!candidates.empty())
+    {
+        int c = candidates.back();
+        candidates.pop_back();
+        if(!is_core(c) || in.live[c] != 1 || out.live[c] != 1)
+            continue;
+
+        Entry from = live_entry(in, c);     /* u, M[c][u] */
+        Entry to   = live_entry(out, c);    /* w, M[w][c] */
+        int u = from.node;
+        int w = to.node;
+        double s = 1.0 / (1.0 - diagonal[c]);
+
+        reduction.roles[c] = NodeRole::ELIMINATED;
+        reduction.substitutions.push_back(Substitution{c, u, w, s * from.weight, s, s * to.weight});
+        out.live[u]--;
+        in.live[w]--;
+
+        double weight = to.weight * s * from.weight;
+        if(u == w)
+            diagonal[u] += weight;
+        else
+        {
+            out.add(u, Entry{w, weight});
+            in.add(w, Entry{u, weight});
+        }
+        candidates.push_back(u);
+        candidates.push_back(w);
+    }
+
+    /* What survives, renumbered in node order, with repeated terms merged */
+    std::vector<int> renumbered(n, -1);
+    for(size_t v = 0; v < n; v++)
+    {
+        if(!is_core(static_cast<int>(v)))
+            continue;
+        renumbered[v] = static_cast<int>(reduction.core.size());
+        reduction.core.push_back(static_cast<int>(v));
+    }
+
+    const size_t k = reduction.core.size();
+    CSR& core = reduction.core_in_links;
+    core.offsets.assign(k + 1, 0);
+    std::vector<std::pair<int, double>> row;
+    for(size_t i = 0; i < k; i++)
+    {
+        int v = reduction.core[i];
+        row.clear();
+        in.for_each(v, [&](const Entry& entry) {
+            if(is_core(entry.node))
+                row.emplace_back(renumbered[entry.node], entry.weight);
+        });
+        if(diagonal[v] != 0.0)
+            row.emplace_back(static_cast<int>(i), diagonal[v]);
+        std::sort(row.begin(), row.end(),
+                  [](const std::pair<int, double>& a, const std::pair<int, double>& b) { return a.first < b.first; });
+
+        for(size_t j = 0; j < row.size(); j++)
+        {
+            if(j > 0 && row[j].first == row[j - 1].first)
+            {
+                core.weights.back() += row[j].second;
+                continue;
+            }
+            core.indices.push_back(row[j].first);
+            core.weights.push_back(row[j].second);
+        }
+        core.offsets[i + 1] = core.indices.size();
+    }
+
+    /* Columns scaled to sum 1, the way out-degrees normalize the graph's own in-links */
+    pr_vector<int> counts;
+    column_sums(core, k, counts, reduction.core_column_sums);
+    for(size_t e = 0; e < core.num_entries(); e++)
+        core.weights[e] /= reduction.core_column_sums[core.indices[e]];
+    return reduction;
+}
+
+/*
+ * Iterating y = M y + b directly converges no faster than alpha^k, since
+ * nothing damps the dominant mode of M. Normalized, y / |y|_1 is instead the
+ * stationary vector of a Markov chain on the core: score kept in the core
+ * moves along M, and what leaves it (teleport, dangling, downstream) comes
+ * back along b:
+ *
+ *     x <- M x + (1 - |M x|_1) * b / |b|_1
+ *
+ * the lumped iteration with b in place of the teleport vector, at the rate
+ * of a power iteration. Afterwards y = x * |b|_1 / (1 - |M x|_1).
+ */
+template <typename Scalar>
+static size_t solve_core(const GraphReduction& reduction, const pr_vector<double>& constants,
+                         const PageRankOptions& options, ConvergenceTracker& tracker, size_t max_iter, bool prefetch,
+                         const std::vector<size_t>& splits, std::vector<double>& y)
+{
+    using Features = KernelFeatures<Scalar, true>;
+
+    const CSR& core = reduction.core_in_links;
+    const pr_vector<double>& column_sums = reduction.core_column_sums;
+    const size_t k = reduction.core.size();
+
+    double constant_mass = 0.0;
+    for(double constant : constants)
+        constant_mass += constant;
+    pr_vector<double> target(k);
+    for(size_t i = 0; i < k; i++)
+        target[i] = constants[i] / constant_mass;
+
+    pr_vector<Scalar> r(k, static_cast<Scalar>(1.0 / static_cast<double>(k)));
+    pr_vector<Scalar> r_new;
+    if(!options.in_place)
+        r_new.resize(k, Scalar(0));
+    pr_vector<Scalar> scaled(k);
+
+    GatherArgs<Scalar> args;
+    args.in_links        = &core;
+    args.scaled          = scaled.data();
+    args.inv_out_degrees = column_sums.data();
+    args.teleport        = target.data();
+    args.dangling        = nullptr;
+    args.alpha           = 1.0;
+    args.base            = 0.0;
+    args.distance        = std::max<size_t>(options.prefetch_distance, 1);
+    args.prefetch        = prefetch;
+
+    /* Pre-scales the scores by the kept shares and totals what stays */
+    auto kept_mass = [&](auto summation) {
+        constexpr Summation S = decltype(summation)::value;
+        std::vector<double> partial_mass(splits.size() - 1);
+        parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+            prescale(r.data() + begin, column_sums.data() + begin, scaled.data() + begin, end - begin);
+            partial_mass[t] = sum<S>(scaled.data() + begin, end - begin);
+        });
+        Accumulator<S> mass;
+        for(double part : partial_mass)
+            mass.add(part);
+        return mass.value();
+    };
+
+    size_t iterations = 0;
+    for(size_t i = 0; i < max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            args.teleport_scale = 1.0 - kept_mass(summation);
+            args.r_old = r.data();
+            args.r_new = options.in_place ? r.data() : r_new.data();
+
+            std::vector<Residual<S>> partial(splits.size() - 1);
+            parallel_ranges(splits, [&](size_t t, size_t begin, size_t end) {
+                partial[t] = options.in_place ? gather_step<Features, true, S>(args, begin, end, measure)
+                                              : gather_step<Features, false, S>(args, begin, end, measure);
+            });
+
+            Residual<S> residual;
+            for(const Residual<S>& part : partial)
+                residual.merge(part);
+
+            /* Sweeps do not keep the sum at 1, which the kept mass relies on */
+            if(options.in_place)
+                renormalize<S>(r.data(), k);
+            else
+                r.swap(r_new);
+            return residual.value(options.norm);
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    dispatch_summation(options.summation, [&](auto summation) {
+        double scale = constant_mass / (1.0 - kept_mass(summation));
+        for(size_t i = 0; i < k; i++)
+            y[reduction.core[i]] = static_cast<double>(r[i]) * scale;
+        return 0.0;
+    });
+    return iterations;
+}
+
+/* sum_{u -> v} w(u, v) / out(u) * y_u over the graph's own in-links */
+static double inflow(const CSR& in_links, const pr_vector<double>& inv_out_degrees, const std::vector<double>& y, int v)
+{
+    double sum = 0.0;
+    for(size_t e = in_links.offsets[v]; e < in_links.offsets[v + 1]; e++)
+    {
+        int u = in_links.indices[e];
+        double w = in_links.is_weighted() ? in_links.weights[e] : 1.0;
+        sum += w * inv_out_degrees[u] * y[u];
+    }
+    return sum;
+}
+
+const GraphReduction& Graph::get_reduction()
+{
+    build_sparse();
+    if(this->reduction_dirty)
+    {
+        this->reduction = reduce_graph(this->in_links, this->inv_out_degrees, this->out_degrees, this->ALPHA);
+        this->reduction_dirty = false;
+    }
+    return this->reduction;
+}
+
+/*
+ * Solves on the reduced graph and expands the scores back exactly. The
+ * teleport vector is pushed through the reduction first: upstream scores in
+ * order, what they feed into the core, then the constants the eliminations
+ * move along. Afterwards the core nodes are solved, eliminated ones follow
+ * from their substitutions in reverse, downstream ones from one gather each
+ * starting at the sinks' far end, and all are normalized together. When no
+ * teleport weight reaches the core, its scores are all zero and there is
+ * nothing to iterate.
+ */
+struct PageRankResult Graph::solve_reduced(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    if(n == 0)
+        return PageRankResult{{}, {}, 0};
+
+    const GraphReduction& reduction = get_reduction();
+    const pr_vector<double> teleport = build_teleport_vector(options);
+    const double alpha = this->ALPHA;
+    const size_t k = reduction.core.size();
+
+    /* Only upstream scores are set while the core constants are gathered */
+    std::vector<double> y(n, 0.0);
+    for(int u : reduction.upstream_order)
+        y[u] = alpha * inflow(this->in_links, this->inv_out_degrees, y, u) + teleport[u];
+
+    std::vector<double> constants(n, 0.0);
+    for(size_t v = 0; v < n; v++)
+        if(reduction.roles[v] == NodeRole::CORE || reduction.roles[v] == NodeRole::ELIMINATED)
+            constants[v] = alpha * inflow(this->in_links, this->inv_out_degrees, y, static_cast<int>(v)) + teleport[v];
+    for(const Substitution& sub : reduction.substitutions)
+        constants[sub.target] += sub.flow * constants[sub.node];
+
+    pr_vector<double> core_constants(k);
+    bool reached = false;
+    for(size_t i = 0; i < k; i++)
+    {
+        core_constants[i] = constants[reduction.core[i]];
+        reached = reached || core_constants[i] > 0.0;
+    }
+
+    size_t scalar_size = (options.precision == Precision::FLOAT) ? sizeof(float) : sizeof(double);
+    bool prefetch = (options.prefetch == Prefetch::ON) ||
+                    (options.prefetch == Prefetch::AUTO && k * scalar_size > last_level_cache_size());
+
+    const CSR& core = reduction.core_in_links;
+    size_t threads = 1;
+    if(!options.in_place)
+        threads = options.num_threads != 0 ? options.num_threads : threads_for(k + core.num_entries(), SPARSE_WORK_PER_THREAD);
+    std::vector<size_t> splits = balanced_row_splits(core, threads);
+
+    #ifdef DEBUG
+        std::cout << "Reduced graph: " << k << " of " << n << " nodes, "
+                  << core.num_entries() << " of " << this->in_links.num_entries() << " edges ("
+                  << reduction.upstream_order.size() << " upstream, " << reduction.downstream_order.size()
+                  << " downstream, " << reduction.substitutions.size() << " eliminated), prefetch "
+                  << (prefetch ? "on" : "off") << ", " << splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    ConvergenceTracker tracker(options.check_every, this->EPSILON, this->MAX_ITER);
+    size_t iterations = 0;
+    if(reached)
+        iterations = (options.precision == Precision::FLOAT)
+            ? solve_core<float>(reduction, core_constants, options, tracker, this->MAX_ITER, prefetch, splits, y)
+            : solve_core<double>(reduction, core_constants, options, tracker, this->MAX_ITER, prefetch, splits, y);
+    else
+        tracker.mark_exact();
+
+    for(size_t i = reduction.substitutions.size(); i-- > 0;)
+    {
+        const Substitution& sub = reduction.substitutions[i];
+        y[sub.node] = sub.coefficient * y[sub.source] + sub.scale * constants[sub.node];
+    }
+
+    for(size_t i = reduction.downstream_order.size(); i-- > 0;)
+    {
+        int v = reduction.downstream_order[i];
+        y[v] = alpha * inflow(this->in_links, this->inv_out_degrees, y, v) + teleport[v];
+    }
+
+    dispatch_summation(options.summation, [&](auto summation) {
+        renormalize<decltype(summation)::value>(y.data(), n);
+        return 0.0;
+    });
+
+    PageRankResult result{std::move(y), tracker.get_history(), iterations};
+    result.num_threads = splits.size() - 1;
+    result.termination = tracker.get_reason();
+    return result;
+}
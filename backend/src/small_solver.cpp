@@ -0,0 +1,162 @@
+#include "graph.h"
+#include "convergence.h"
+#include "summation.h"
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#ifdef DEBUG 
+    #include <iostream>
+#endif
+
+/*
+ * Fixed-size path for interactive graphs (n <= SMALL_GRAPH_MAX).
+ * The Google matrix and both score vectors live in stack arrays and the
+ * mat-vec is instantiated for every n, so the row dot products unroll fully.
+ * The only heap allocations are the result vectors. Steps are Jacobi steps
+ * under the summation mode and renormalization of the options.
+ */
+using SmallMatrix = std::array<double, SMALL_GRAPH_MAX * SMALL_GRAPH_MAX>;
+
+template <size_t N, size_t... I>
+static inline double small_dot(const double* g_row, const double* r, std::index_sequence<I...>)
+{
+    return (0.0 + ... + (g_row[I] * r[I]));
+}
+
+template <size_t N, Summation S>
+static inline double small_step(const SmallMatrix& google, ConvergenceNorm norm, bool measure,
+                                const std::array<double, N>& r_old, std::array<double, N>& r_new)
+{
+    Residual<S> residual;
+
+    #pragma GCC unroll 16
+    for(size_t row = 0; row < N; row++)
+    {
+        const double* g_row = google.data() + row * N;
+        double sum;
+        if constexpr (S == Summation::NAIVE)
+            sum = small_dot<N>(g_row, r_old.data(), std::make_index_sequence<N>{});
+        else
+        {
+            Accumulator<S> total;
+            for(size_t col = 0; col < N; col++)
+                total.add(g_row[col] * r_old[col]);
+            sum = total.value();
+        }
+        r_new[row] = sum;
+
+        if(measure)
+            residual.add(r_old[row], sum);
+    }
+    return residual.value(norm);
+}
+
+template <size_t N>
+static struct PageRankResult small_power_iteration(const SmallMatrix& google, const PageRankOptions& options,
+                                                   double epsilon, size_t max_iter)
+{
+    ConvergenceTracker tracker(options.check_every, epsilon, max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+
+    std::array<double, N> r_old;
+    std::array<double, N> r_new;
+    r_old.fill(1.0 / static_cast<double>(N));
+
+    for(size_t i = 0; i < max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double d = small_step<N, S>(google, options.norm, measure, r_old, r_new);
+            std::swap(r_old, r_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old.data(), N);
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old.data(), N))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+using SmallSolveFn = struct PageRankResult (*)(const SmallMatrix&, const PageRankOptions&, double, size_t);
+
+template <size_t... I>
+static constexpr std::array<SmallSolveFn, sizeof...(I)> make_small_solvers(std::index_sequence<I...>)
+{
+    return {{ &small_power_iteration<I + 1>... }};
+}
+
+/* small_solvers[n - 1] is the solver instantiated for n nodes */
+static constexpr auto small_solvers = make_small_solvers(std::make_index_sequence<SMALL_GRAPH_MAX>{});
+
+struct PageRankResult Graph::solve_small(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    if(n == 0)
+        return PageRankResult{{}, {}, 0};
+
+    if(n > SMALL_GRAPH_MAX)
+        return solve_dense(options);
+
+    build_sparse();
+
+    std::array<double, SMALL_GRAPH_MAX> teleport;
+    fill_teleport_vector(options, teleport.data());
+
+    /* Google matrix, row-major with stride n: teleport part first, then the link part */
+    SmallMatrix google;
+    for(size_t row = 0; row < n; row++)
+    {
+        for(size_t col = 0; col < n; col++)
+            google[row * n + col] = (1.0 - this->ALPHA) * teleport[row];
+    }
+
+    for(size_t dest = 0; dest < n; dest++)
+    {
+        for(size_t e = this->in_links.offsets[dest]; e < this->in_links.offsets[dest + 1]; e++)
+        {
+            int src = this->in_links.indices[e];
+            double weight = this->in_links.is_weighted() ? this->in_links.weights[e] : 1.0;
+            google[dest * n + src] += this->ALPHA * weight * this->inv_out_degrees[src];
+        }
+    }
+
+    /* Dangling columns */
+    for(size_t src = 0; src < n; src++)
+    {
+        if(this->out_degrees[src] != 0)
+            continue;
+
+        for(size_t row = 0; row < n; row++)
+        {
+            switch(options.dangling)
+            {
+                case DanglingPolicy::TELEPORT:
+                    google[row * n + src] += this->ALPHA * teleport[row];
+                    break;
+                case DanglingPolicy::SELF_LOOP:
+                    google[row * n + src] += (row == src) ? this->ALPHA : 0.0;
+                    break;
+                default:
+                    google[row * n + src] += this->ALPHA / static_cast<double>(n);
+                    break;
+            }
+        }
+    }
+
+    return small_solvers[n - 1](google, options, this->EPSILON, this->MAX_ITER);
+}
@@ -0,0 +1,145 @@
+#include "graph.h"
+#include "convergence.h"
+#include "kernels.h"
+#include "memory.h"
+#include "parallel.h"
+#include "sparse_problem.h"
+#include "summation.h"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#ifdef DEBUG 
+    #include <iostream>
+#endif
+
+template <typename Features>
+static struct PageRankResult sparse_power_iteration(const SparseProblem& problem,
+                                                    const PageRankOptions& options)
+{
+    using Scalar = typename Features::Scalar;
+
+    ConvergenceTracker tracker(options.check_every, problem.epsilon, problem.max_iter, options.top_k_criterion());
+    size_t iterations = 0;
+    const size_t n = problem.num_nodes;
+
+    /* Double buffer: r_old always holds the newest iterate once a step has been swapped in */
+    pr_vector<Scalar> r_old(n, static_cast<Scalar>(1.0 / static_cast<double>(n)));
+    pr_vector<Scalar> r_new;
+    if(!options.in_place)
+        r_new.resize(n, Scalar(0));
+
+    /* Scores pre-scaled by 1 / out-degree, the only array the gather touches at random */
+    pr_vector<Scalar> scaled(n);
+    GatherArgs<Scalar> args = gather_args(problem, options, scaled.data());
+
+    /* Extrapolated Jacobi steps also keep the iterate before r_old */
+    const bool accelerate = (options.acceleration != Acceleration::NONE) && !options.in_place;
+    ExtrapolationWeights weights(problem.alpha, options.acceleration == Acceleration::CHEBYSHEV, tracker.get_check_every());
+    pr_vector<Scalar> r_prev;
+    if(accelerate)
+        r_prev.resize(n, Scalar(0));
+
+    for(size_t i = 0; i < problem.max_iter; i++)
+    {
+        bool measure = tracker.measure(i);
+        double diff = dispatch_summation(options.summation, [&](auto summation) {
+            constexpr Summation S = decltype(summation)::value;
+
+            double d = power_step<Features, S>(problem, options, args, measure, r_old.data(),
+                                               options.in_place ? r_old.data() : r_new.data());
+
+            if(accelerate)
+            {
+                if(measure)
+                    weights.observe(d);
+                double omega = weights.next();
+                if(omega != 1.0)
+                    parallel_ranges(problem.row_splits, [&](size_t, size_t begin, size_t end) {
+                        extrapolate(r_prev.data() + begin, r_new.data() + begin, omega, end - begin);
+                    });
+                r_prev.swap(r_old);
+            }
+
+            /* An in-place sweep does not preserve the sum, a Jacobi step does */
+            if(options.in_place)
+                renormalize<S>(r_old.data(), n);
+            else
+                r_old.swap(r_new);
+
+            if(options.renormalize_every != 0 && (i + 1) % options.renormalize_every == 0)
+                renormalize<S>(r_old.data(), n);
+            return d;
+        });
+        iterations++;
+
+        if(measure && tracker.converged(diff, r_old.data(), n))
+        {
+            #ifdef DEBUG
+                std::cout << "\nConverged after " << i+1 << " iterations." << std::endl;
+            #endif
+            break;
+        }
+    }
+
+    PageRankResult result{std::vector<double>(r_old.begin(), r_old.end()), tracker.get_history(), iterations};
+    result.termination = tracker.get_reason();
+    return result;
+}
+
+/* Sets up the shared inputs of a sparse solve: teleport vector, dangling set, prefetching and row ranges */
+SparseProblem Graph::prepare_sparse(const PageRankOptions& options)
+{
+    const size_t n = this->num_nodes;
+    build_sparse();
+
+    SparseProblem problem;
+    problem.in_links        = &this->in_links;
+    problem.inv_out_degrees = this->inv_out_degrees.data();
+    problem.dangling_nodes  = &this->stats.dangling_nodes;
+    problem.num_nodes       = n;
+    problem.alpha           = this->ALPHA;
+    problem.epsilon         = this->EPSILON;
+    problem.max_iter        = this->MAX_ITER;
+
+    /* Dangling nodes, gathered once per iteration */
+    problem.dangling_flags.assign(n, 0.0);
+    for(int u : this->stats.dangling_nodes)
+        problem.dangling_flags[u] = 1.0;
+
+    problem.teleport = build_teleport_vector(options);
+
+    /* Prefetching only pays off once the gathered scores no longer fit in the last-level cache */
+    size_t scalar_size = (options.precision == Precision::FLOAT) ? sizeof(float) : sizeof(double);
+    size_t working_set = n * scalar_size;
+    problem.prefetch = (options.prefetch == Prefetch::ON) ||
+                       (options.prefetch == Prefetch::AUTO && working_set > last_level_cache_size());
+
+    /* A Gauss-Seidel sweep reads the scores it just wrote, so only Jacobi steps are split */
+    size_t threads = 1;
+    if(!options.in_place)
+        threads = options.num_threads != 0 ? options.num_threads
+                                            : threads_for(n + this->in_links.num_entries(), SPARSE_WORK_PER_THREAD);
+    problem.row_splits = balanced_row_splits(this->in_links, threads);
+    return problem;
+}
+
+struct PageRankResult Graph::solve_sparse(const PageRankOptions& options)
+{
+    if(this->num_nodes == 0)
+        return PageRankResult{{}, {}, 0};
+
+    SparseProblem problem = prepare_sparse(options);
+
+    #ifdef DEBUG
+        std::cout << "Sparse solver: " << problem.num_nodes << " nodes, " << this->in_links.num_entries() << " edges, "
+                  << "prefetch " << (problem.prefetch ? "on" : "off") << ", "
+                  << problem.row_splits.size() - 1 << " threads" << std::endl;
+    #endif
+
+    PageRankResult result = dispatch_features(problem, options, [&](auto features) {
+        return sparse_power_iteration<decltype(features)>(problem, options);
+    });
+    result.num_threads = problem.row_splits.size() - 1;
+    return result;
+}
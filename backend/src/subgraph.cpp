@@ -0,0 +1,149 @@
+#include "graph.h"
+#include "kernels.h"
+#include "parallel.h"
+#include <cstdint>
+#include <vector>
+#ifdef DEBUG
+    #include <iostream>
+#endif
+
+/* Below this many kept rows plus edges per thread the copy is not worth a thread start */
+static constexpr size_t SUBGRAPH_WORK_PER_THREAD = size_t{1} << 16;
+
+/* One bit per node of the parent graph, with a rank over the words for renumbering */
+struct NodeBitmap {
+    std::vector<uint64_t> words;
+    std::vector<size_t> rank;       /* Set bits before word w */
+
+    explicit NodeBitmap(size_t num_nodes) : words((num_nodes + 63) / 64, 0), rank(words.size() + 1, 0) {}
+
+    void set(size_t node) { words[node >> 6] |= uint64_t{1} << (node & 63); }
+    bool test(size_t node) const { return (words[node >> 6] >> (node & 63)) & 1; }
+
+    void build_rank()
+    {
+        for(size_t w = 0; w < words.size(); w++)
+            rank[w + 1] = rank[w] + popcount64(words[w]);
+    }
+
+    /* Index of a set node among the set nodes, in parent order */
+    size_t index_of(size_t node) const
+    {
+        uint64_t below = words[node >> 6] & ((uint64_t{1} << (node & 63)) - 1);
+        return rank[node >> 6] + popcount64(below);
+    }
+};
+
+/*
+ * Copies the subgraph induced by `labels` straight from the sparse storage:
+ * kept nodes are marked in a bitmap, and every kept row of the in-links is
+ * filtered down to kept sources in two parallel passes (count, then fill).
+ * Renumbering preserves parent order, so filtered rows stay sorted and the
+ * copy's in-links are final without another CSR build. Degrees, statistics
+ * and edge lists of the copy are derived from them; nothing goes through
+ * add_node() or add_edge().
+ */
+Graph Graph::subgraph(const std::vector<std::string_view>& labels)
+{
+    build_sparse();
+
+    std::vector<int64_t> indices(labels.size());
+    resolve_labels(labels, indices.data());
+
+    NodeBitmap keep(this->num_nodes);
+    for(int64_t index : indices)
+        if(index != -1)
+            keep.set(static_cast<size_t>(index));
+    keep.build_rank();
+
+    const size_t n = keep.rank.back();
+    std::vector<int> kept_nodes;
+    kept_nodes.reserve(n);
+    for(size_t v = 0; v < this->num_nodes; v++)
+        if(keep.test(v))
+            kept_nodes.push_back(static_cast<int>(v));
+
+    Graph sub;
+    sub.memory_budget = this->memory_budget;
+    sub.num_nodes = n;
+
+    /* Labels and their index, hashed on every thread */
+    size_t label_threads = threads_for(n, SUBGRAPH_WORK_PER_THREAD);
+    std::vector<uint64_t> hashes(n);
+    sub.index_to_node.resize(n);
+    parallel_for(n, label_threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            sub.index_to_node[i] = this->index_to_node[kept_nodes[i]];
+            hashes[i] = LabelIndex::hash(sub.index_to_node[i]);
+        }
+    });
+    sub.label_index.reserve(n);
+    for(size_t i = 0; i < n; i++)
+        sub.label_index.insert(hashes[i], static_cast<int>(i));
+
+    /* Pass 1: kept sources of every kept row */
+    const CSR& parent = this->in_links;
+    const bool weighted = parent.is_weighted();
+    size_t threads = threads_for(n + parent.num_entries(), SUBGRAPH_WORK_PER_THREAD);
+    std::vector<size_t> row_splits = even_splits(n, threads);
+
+    sub.in_links.offsets.assign(n + 1, 0);
+    parallel_ranges(row_splits, [&](size_t, size_t begin, size_t end) {
+        for(size_t row = begin; row < end; row++)
+        {
+            int v = kept_nodes[row];
+            size_t count = 0;
+            for(size_t e = parent.offsets[v]; e < parent.offsets[v + 1]; e++)
+                count += keep.test(static_cast<size_t>(parent.indices[e]));
+            sub.in_links.offsets[row + 1] = count;
+        }
+    });
+    for(size_t row = 0; row < n; row++)
+        sub.in_links.offsets[row + 1] += sub.in_links.offsets[row];
+
+    /* Pass 2: copy them renumbered, along with the edge lists of the copy */
+    const size_t m = sub.in_links.offsets[n];
+    sub.in_links.indices.resize(m);
+    sub.edge_src.resize(m);
+    sub.edge_dest.resize(m);
+    if(weighted)
+    {
+        sub.in_links.weights.resize(m);
+        sub.edge_weight.resize(m);
+    }
+
+    parallel_ranges(row_splits, [&](size_t, size_t begin, size_t end) {
+        for(size_t row = begin; row < end; row++)
+        {
+            int v = kept_nodes[row];
+            size_t position = sub.in_links.offsets[row];
+            for(size_t e = parent.offsets[v]; e < parent.offsets[v + 1]; e++)
+            {
+                size_t u = static_cast<size_t>(parent.indices[e]);
+                if(!keep.test(u))
+                    continue;
+
+                int source = static_cast<int>(keep.index_of(u));
+                sub.in_links.indices[position] = source;
+                sub.edge_src[position]  = source;
+                sub.edge_dest[position] = static_cast<int>(row);
+                if(weighted)
+                {
+                    sub.in_links.weights[position] = parent.weights[e];
+                    sub.edge_weight[position]      = parent.weights[e];
+                }
+                position++;
+            }
+        }
+    });
+
+    sub.finish_sparse(threads);
+
+    #ifdef DEBUG
+        std::cout << "Subgraph: " << n << " of " << this->num_nodes << " nodes, "
+                  << m << " of " << parent.num_entries() << " edges." << std::endl;
+    #endif
+
+    return sub;
+}
@@ -0,0 +1,184 @@
+#include "graph.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* L1 distance to the reference a converged solve may be off by, EPSILON is 1e-6 */
+constexpr double AGREEMENT_TOLERANCE = 1e-4;
+
+/* Distance of the total score from 1, in double and in float storage */
+constexpr double MASS_TOLERANCE = 1e-9;
+constexpr double FLOAT_MASS_TOLERANCE = 1e-6;
+
+struct TestGraph {
+    const char* name;
+    Graph graph;
+};
+
+/* Random graph on n0 .. n{n-1}: a `dangling` share of the nodes has no out-links, the rest 1 to max_degree */
+static Graph random_graph(size_t n, size_t max_degree, double dangling, bool weighted, unsigned seed)
+{
+    Graph graph;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    for(size_t v = 0; v < n; v++)
+        graph.add_node("n" + std::to_string(v));
+    for(size_t u = 0; u < n; u++)
+    {
+        if(unit(rng) < dangling)
+            continue;
+        size_t degree = 1 + rng() % max_degree;
+        for(size_t k = 0; k < degree; k++)
+            graph.add_edge("n" + std::to_string(u), "n" + std::to_string(rng() % n),
+                           weighted ? 0.5 + static_cast<double>(rng() % 4) : 1.0);
+    }
+    return graph;
+}
+
+static const char* dangling_name(DanglingPolicy dangling)
+{
+    switch(dangling)
+    {
+        case DanglingPolicy::TELEPORT:  return "teleport";
+        case DanglingPolicy::SELF_LOOP: return "self-loop";
+        default:                        return "uniform";
+    }
+}
+
+/* Options of the reference solve: Jacobi steps on the sparse solver, same damping, dangling and teleport */
+static PageRankOptions reference_options(const PageRankOptions& options)
+{
+    PageRankOptions reference;
+    reference.solver          = Solver::SPARSE;
+    reference.dangling        = options.dangling;
+    reference.personalization = options.personalization;
+    return reference;
+}
+
+/* Compares scores against the reference, prints and counts a mismatch */
+static int compare(const char* graph, const std::string& what, const PageRankOptions& options,
+                   const PageRankResult& result, const std::vector<double>& expected)
+{
+    double distance = 0.0, mass = 0.0;
+    bool sized = (result.pagerank_vector.size() == expected.size());
+    for(size_t v = 0; sized && v < expected.size(); v++)
+    {
+        distance += std::abs(result.pagerank_vector[v] - expected[v]);
+        mass     += result.pagerank_vector[v];
+    }
+
+    double mass_tolerance = (options.precision == Precision::FLOAT) ? FLOAT_MASS_TOLERANCE : MASS_TOLERANCE;
+    if(sized && distance <= AGREEMENT_TOLERANCE && std::abs(mass - 1.0) <= mass_tolerance)
+        return 0;
+
+    std::printf("FAIL %s: %s, dangling %s, %s, %s: L1 distance %g, mass %g, %zu iterations\n",
+                graph, what.c_str(), dangling_name(options.dangling), options.in_place ? "in place" : "Jacobi",
+                options.personalization.empty() ? "uniform teleport" : "personalized",
+                distance, mass, result.iterations);
+    return 1;
+}
+
+/* Solves with `options` and compares against the reference solve of the same graph */
+static int check(TestGraph& test, const PageRankOptions& options, const std::string& what)
+{
+    const std::vector<double> expected = test.graph.compute_pagerank(reference_options(options)).pagerank_vector;
+    return compare(test.name, what, options, test.graph.compute_pagerank(options), expected);
+}
+
+int main()
+{
+    /* Sized so AUTO reaches the small, sparse, lumped and bitset solvers */
+    std::vector<TestGraph> graphs;
+    graphs.push_back({"small-12", random_graph(12, 3, 0.3, false, 1)});
+    graphs.push_back({"crawl-60", random_graph(60, 4, 0.5, false, 2)});
+    graphs.push_back({"crawl-300", random_graph(300, 4, 0.5, false, 3)});
+    graphs.push_back({"crawl-500", random_graph(500, 4, 0.5, false, 4)});
+    graphs.push_back({"weighted-300", random_graph(300, 5, 0.3, true, 6)});
+    graphs.push_back({"dense-200", random_graph(200, 120, 0.1, false, 5)});
+
+    const std::pair<Solver, const char*> solvers[] = {
+        {Solver::AUTO, "auto"}, {Solver::DENSE, "dense"}, {Solver::SPARSE, "sparse"}, {Solver::SMALL, "small"},
+        {Solver::LUMPED, "lumped"}, {Solver::AGGREGATION, "aggregation"}, {Solver::BITSET, "bitset"}
+    };
+    const DanglingPolicy policies[] = {DanglingPolicy::UNIFORM, DanglingPolicy::TELEPORT, DanglingPolicy::SELF_LOOP};
+
+    /* Options layered on the sparse solver, each compared against the plain solve */
+    std::vector<std::pair<std::string, PageRankOptions>> variants;
+    {
+        PageRankOptions options;
+        options.solver = Solver::SPARSE;
+
+        PageRankOptions reduced = options;          reduced.reduce = true;
+        PageRankOptions chebyshev = options;        chebyshev.acceleration = Acceleration::CHEBYSHEV;
+        PageRankOptions momentum = options;         momentum.acceleration = Acceleration::MOMENTUM;
+        PageRankOptions single = options;           single.precision = Precision::FLOAT;
+        PageRankOptions kahan = options;            kahan.summation = Summation::KAHAN;
+        PageRankOptions pairwise = options;         pairwise.summation = Summation::PAIRWISE;
+        PageRankOptions renormalized = options;     renormalized.renormalize_every = 1;
+        PageRankOptions cheirank = options;         cheirank.cheirank = true;
+        PageRankOptions lumped_reduced = reduced;   lumped_reduced.solver = Solver::LUMPED;
+
+        variants = {{"sparse reduced", reduced}, {"sparse chebyshev", chebyshev}, {"sparse momentum", momentum},
+                    {"sparse float", single}, {"sparse kahan", kahan}, {"sparse pairwise", pairwise},
+                    {"sparse renormalized", renormalized}, {"sparse cheirank", cheirank},
+                    {"lumped reduced", lumped_reduced}};
+    }
+
+    int failures = 0, checks = 0;
+    for(DanglingPolicy dangling : policies)
+        for(bool personalized : {false, true})
+        {
+            for(bool in_place : {false, true})
+            {
+                PageRankOptions options;
+                options.dangling = dangling;
+                options.in_place = in_place;
+                if(personalized)
+                    options.personalization["n3"] = 1.0;
+
+                /* Every solver on every graph; the ones a graph does not suit fall back, and must agree too */
+                for(TestGraph& test : graphs)
+                {
+                    for(const auto& [solver, name] : solvers)
+                    {
+                        options.solver = solver;
+                        failures += check(test, options, name);
+                        checks++;
+                    }
+                }
+
+                for(auto [name, variant] : variants)
+                {
+                    variant.dangling        = dangling;
+                    variant.in_place        = in_place;
+                    variant.personalization = options.personalization;
+                    for(TestGraph& test : graphs)
+                    {
+                        failures += check(test, variant, name);
+                        checks++;
+                    }
+                }
+
+                /* Every graph in one block-diagonal solve */
+                std::vector<Graph*> batch;
+                for(TestGraph& test : graphs)
+                    batch.push_back(&test.graph);
+                options.solver = Solver::SPARSE;
+                std::vector<PageRankResult> results = Graph::solve_batch(batch, options);
+                for(size_t b = 0; b < graphs.size(); b++)
+                {
+                    const std::vector<double> expected =
+                        graphs[b].graph.compute_pagerank(reference_options(options)).pagerank_vector;
+                    failures += compare(graphs[b].name, "batch", options, results[b], expected);
+                    checks++;
+                }
+            }
+        }
+
+    std::printf("%d of %d solves agree with the sparse solver\n", checks - failures, checks);
+    return failures == 0 ? 0 : 1;
+}